@@ -3,65 +3,920 @@
 #include <algorithm>
 #include <any>
 #include <array>
+#include <bit>
+#include <cassert>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <new>
+#include <stdexcept>
 #include <utility>
 
+// Largest alternative count kept in the recursive VariadicUnion, see
+// variant_util::FLAT_STORAGE_LIMIT.
+#ifndef VARIANT_FLAT_STORAGE_LIMIT
+#define VARIANT_FLAT_STORAGE_LIMIT 64
+#endif
+
+// Set to 1 to count, per list of alternatives, alternative changes, failed
+// Get calls, exceptions that leave a variant valueless, and the
+// combinations of alternatives Visit dispatches to. See DumpVariantStats.
+// At 0, the default, the hooks compile to nothing.
+#ifndef VARIANT_INSTRUMENTATION
+#define VARIANT_INSTRUMENTATION 0
+#endif
+
+#if VARIANT_INSTRUMENTATION
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <string_view>
+#include <vector>
+#endif
+
 namespace variant_util {
 constexpr size_t NPOS = -1;
 
-template <size_t Index, typename T, typename...>
+// Kept cold and out of line, so a checked access only adds a compare and a
+// call to its caller instead of the exception construction.
+[[noreturn, gnu::cold, gnu::noinline]] inline void throw_bad_variant_access() {
+    throw std::runtime_error("Bad variant access!");
+}
+
+// Both lookups expand the whole type list at once instead of recursing once
+// per alternative, so their instantiation depth stays constant however many
+// alternatives there are.
+template <typename T, typename... Types>
 struct get_index_by_type {
-    static const size_t value = NPOS;
+    static constexpr size_t value = [] {
+        constexpr bool matches[] = {std::is_same_v<T, Types>..., false};
+        for (size_t i = 0; i < sizeof...(Types); ++i) {
+            if (matches[i]) {
+                return i;
+            }
+        }
+        return NPOS;
+    }();
 };
 
-template <size_t Index, typename T, typename Head, typename... Tail>
-struct get_index_by_type<Index, T, Head, Tail...> {
-    static const size_t value =
-        std::is_same_v<T, Head>
-            ? Index
-            : get_index_by_type<Index + 1, T, Tail...>::value;
+template <typename T, typename... Types>
+constexpr size_t get_index_by_type_v = get_index_by_type<T, Types...>::value;
+
+struct Empty {};
+
+template <size_t Index, typename T>
+struct indexed_type {
+    using type = T;
 };
 
-template <typename... Types>
-constexpr size_t get_index_by_type_v = get_index_by_type<0, Types...>::value;
+template <typename Seq, typename... Types>
+struct indexed_types;
 
-struct Empty {};
+template <size_t... Is, typename... Types>
+struct indexed_types<std::index_sequence<Is...>, Types...>
+    : indexed_type<Is, Types>... {};
+
+// Deduction picks the one base of indexed_types with the given index.
+template <size_t Index, typename T>
+indexed_type<Index, T> select_indexed(const indexed_type<Index, T>&);
 
-template <size_t Index, typename...>
+template <size_t Index, typename... Types>
 struct get_type_by_index {
     using type = Empty;
 };
 
-template <size_t Index, typename Head, typename... Tail>
-struct get_type_by_index<Index, Head, Tail...> {
-    using type = std::conditional_t<
-        Index == 0, Head, typename get_type_by_index<Index - 1, Tail...>::type>;
+template <size_t Index, typename... Types>
+    requires(Index < sizeof...(Types))
+struct get_type_by_index<Index, Types...> {
+    using type = typename decltype(select_indexed<Index>(
+        indexed_types<std::index_sequence_for<Types...>, Types...>()))::type;
 };
 
 template <size_t Index, typename... Types>
 using get_type_by_index_t = typename get_type_by_index<Index, Types...>::type;
+
+// Smallest unsigned type able to hold every alternative index plus a
+// dedicated valueless sentinel (the maximum value of the type).
+template <size_t Count>
+using index_type_t = std::conditional_t<
+    (Count < UINT8_MAX), uint8_t,
+    std::conditional_t<(Count < UINT16_MAX), uint16_t,
+                       std::conditional_t<(Count < UINT32_MAX), uint32_t,
+                                          size_t>>>;
+
+template <size_t Count>
+constexpr index_type_t<Count> valueless_index_v =
+    static_cast<index_type_t<Count>>(-1);
+
+// Special member requirements. The trivial forms refine the plain ones so
+// that the defaulted (trivial) overloads win by subsumption.
+template <typename... Types>
+concept all_trivially_destructible =
+    (std::is_trivially_destructible_v<Types> && ...);
+
+template <typename... Types>
+concept all_copy_constructible = (std::is_copy_constructible_v<Types> && ...);
+
+template <typename... Types>
+concept all_trivially_copy_constructible =
+    all_copy_constructible<Types...> &&
+    (std::is_trivially_copy_constructible_v<Types> && ...);
+
+template <typename... Types>
+concept all_move_constructible = (std::is_move_constructible_v<Types> && ...);
+
+template <typename... Types>
+concept all_trivially_move_constructible =
+    all_move_constructible<Types...> &&
+    (std::is_trivially_move_constructible_v<Types> && ...);
+
+template <typename... Types>
+concept all_trivially_copy_assignable =
+    all_trivially_copy_constructible<Types...> &&
+    all_trivially_destructible<Types...> &&
+    (std::is_trivially_copy_assignable_v<Types> && ...);
+
+template <typename... Types>
+concept all_trivially_move_assignable =
+    all_trivially_move_constructible<Types...> &&
+    all_trivially_destructible<Types...> &&
+    (std::is_trivially_move_assignable_v<Types> && ...);
+
+template <typename... Types>
+concept all_swappable = (std::is_swappable_v<Types> && ...);
+
+// Whether an argument list starts with std::allocator_arg, which selects the
+// uses-allocator overloads of emplace.
+template <typename... Args>
+constexpr bool leading_allocator_arg_v = false;
+
+template <typename First, typename... Rest>
+constexpr bool leading_allocator_arg_v<First, Rest...> =
+    std::is_same_v<std::remove_cvref_t<First>, std::allocator_arg_t>;
+
+// noexcept specifications. Containers such as std::vector only move their
+// elements on reallocation when the move constructor is noexcept.
+template <typename... Types>
+constexpr bool all_nothrow_copy_constructible_v =
+    (std::is_nothrow_copy_constructible_v<Types> && ...);
+
+template <typename... Types>
+constexpr bool all_nothrow_move_constructible_v =
+    (std::is_nothrow_move_constructible_v<Types> && ...);
+
+template <typename... Types>
+constexpr bool all_nothrow_copy_assignable_v =
+    all_nothrow_copy_constructible_v<Types...> &&
+    (std::is_nothrow_copy_assignable_v<Types> && ...);
+
+template <typename... Types>
+constexpr bool all_nothrow_move_assignable_v =
+    all_nothrow_move_constructible_v<Types...> &&
+    (std::is_nothrow_move_assignable_v<Types> && ...);
+
+template <typename... Types>
+constexpr bool all_nothrow_swappable_v =
+    all_nothrow_move_constructible_v<Types...> &&
+    (std::is_nothrow_swappable_v<Types> && ...);
+
+// Largest alternative count dispatched through a switch rather than a
+// function pointer table. The switch becomes a jump table and the callee can
+// still be inlined into every arm.
+constexpr size_t SWITCH_DISPATCH_LIMIT = 32;
+
+// Largest alternative count stored in the recursive VariadicUnion. Longer
+// lists go to AlignedUnion, whose accesses do not recurse through the
+// alternatives, at the price of not being usable in constant expressions.
+constexpr size_t FLAT_STORAGE_LIMIT = VARIANT_FLAT_STORAGE_LIMIT;
+
+template <size_t Index, size_t Count, typename F>
+constexpr decltype(auto) dispatch_arm(F&& f) {
+    static_assert(Index < Count);
+    return std::forward<F>(f)(std::integral_constant<size_t, Index>{});
+}
+
+// Function pointer table for alternative counts above the switch limit.
+template <typename F, typename Seq>
+struct index_table;
+
+template <typename F, size_t... Is>
+struct index_table<F, std::index_sequence<Is...>> {
+    using result_t = decltype(std::declval<F>()(
+        std::integral_constant<size_t, 0>{}));
+
+    template <size_t Index>
+    static constexpr result_t call(F f) {
+        return std::forward<F>(f)(std::integral_constant<size_t, Index>{});
+    }
+
+    static constexpr result_t (*table[])(F) = {&call<Is>...};
+};
+
+// Cases past the last alternative break out to the last arm instead of
+// getting arms of their own. That keeps the number of distinct targets at
+// Count, so GCC emits a short compare chain rather than a jump table for
+// small variants.
+template <size_t Count, typename F>
+constexpr decltype(auto) dispatch_switch(size_t index, F&& f) {
+    switch (index) {
+        case 0:
+            if constexpr (0 < Count) {
+                return dispatch_arm<0, Count>(std::forward<F>(f));
+            }
+            break;
+        case 1:
+            if constexpr (1 < Count) {
+                return dispatch_arm<1, Count>(std::forward<F>(f));
+            }
+            break;
+        case 2:
+            if constexpr (2 < Count) {
+                return dispatch_arm<2, Count>(std::forward<F>(f));
+            }
+            break;
+        case 3:
+            if constexpr (3 < Count) {
+                return dispatch_arm<3, Count>(std::forward<F>(f));
+            }
+            break;
+        case 4:
+            if constexpr (4 < Count) {
+                return dispatch_arm<4, Count>(std::forward<F>(f));
+            }
+            break;
+        case 5:
+            if constexpr (5 < Count) {
+                return dispatch_arm<5, Count>(std::forward<F>(f));
+            }
+            break;
+        case 6:
+            if constexpr (6 < Count) {
+                return dispatch_arm<6, Count>(std::forward<F>(f));
+            }
+            break;
+        case 7:
+            if constexpr (7 < Count) {
+                return dispatch_arm<7, Count>(std::forward<F>(f));
+            }
+            break;
+        case 8:
+            if constexpr (8 < Count) {
+                return dispatch_arm<8, Count>(std::forward<F>(f));
+            }
+            break;
+        case 9:
+            if constexpr (9 < Count) {
+                return dispatch_arm<9, Count>(std::forward<F>(f));
+            }
+            break;
+        case 10:
+            if constexpr (10 < Count) {
+                return dispatch_arm<10, Count>(std::forward<F>(f));
+            }
+            break;
+        case 11:
+            if constexpr (11 < Count) {
+                return dispatch_arm<11, Count>(std::forward<F>(f));
+            }
+            break;
+        case 12:
+            if constexpr (12 < Count) {
+                return dispatch_arm<12, Count>(std::forward<F>(f));
+            }
+            break;
+        case 13:
+            if constexpr (13 < Count) {
+                return dispatch_arm<13, Count>(std::forward<F>(f));
+            }
+            break;
+        case 14:
+            if constexpr (14 < Count) {
+                return dispatch_arm<14, Count>(std::forward<F>(f));
+            }
+            break;
+        case 15:
+            if constexpr (15 < Count) {
+                return dispatch_arm<15, Count>(std::forward<F>(f));
+            }
+            break;
+        case 16:
+            if constexpr (16 < Count) {
+                return dispatch_arm<16, Count>(std::forward<F>(f));
+            }
+            break;
+        case 17:
+            if constexpr (17 < Count) {
+                return dispatch_arm<17, Count>(std::forward<F>(f));
+            }
+            break;
+        case 18:
+            if constexpr (18 < Count) {
+                return dispatch_arm<18, Count>(std::forward<F>(f));
+            }
+            break;
+        case 19:
+            if constexpr (19 < Count) {
+                return dispatch_arm<19, Count>(std::forward<F>(f));
+            }
+            break;
+        case 20:
+            if constexpr (20 < Count) {
+                return dispatch_arm<20, Count>(std::forward<F>(f));
+            }
+            break;
+        case 21:
+            if constexpr (21 < Count) {
+                return dispatch_arm<21, Count>(std::forward<F>(f));
+            }
+            break;
+        case 22:
+            if constexpr (22 < Count) {
+                return dispatch_arm<22, Count>(std::forward<F>(f));
+            }
+            break;
+        case 23:
+            if constexpr (23 < Count) {
+                return dispatch_arm<23, Count>(std::forward<F>(f));
+            }
+            break;
+        case 24:
+            if constexpr (24 < Count) {
+                return dispatch_arm<24, Count>(std::forward<F>(f));
+            }
+            break;
+        case 25:
+            if constexpr (25 < Count) {
+                return dispatch_arm<25, Count>(std::forward<F>(f));
+            }
+            break;
+        case 26:
+            if constexpr (26 < Count) {
+                return dispatch_arm<26, Count>(std::forward<F>(f));
+            }
+            break;
+        case 27:
+            if constexpr (27 < Count) {
+                return dispatch_arm<27, Count>(std::forward<F>(f));
+            }
+            break;
+        case 28:
+            if constexpr (28 < Count) {
+                return dispatch_arm<28, Count>(std::forward<F>(f));
+            }
+            break;
+        case 29:
+            if constexpr (29 < Count) {
+                return dispatch_arm<29, Count>(std::forward<F>(f));
+            }
+            break;
+        case 30:
+            if constexpr (30 < Count) {
+                return dispatch_arm<30, Count>(std::forward<F>(f));
+            }
+            break;
+        case 31:
+            if constexpr (31 < Count) {
+                return dispatch_arm<31, Count>(std::forward<F>(f));
+            }
+            break;
+        default:
+            break;
+    }
+    return dispatch_arm<Count - 1, Count>(std::forward<F>(f));
+}
+
+// Calls f(std::integral_constant<size_t, index>{}) for a runtime index.
+// Out of range indices (NPOS) end up in the last alternative.
+template <size_t Count, typename F>
+constexpr decltype(auto) dispatch_index(size_t index, F&& f) {
+    if constexpr (Count <= SWITCH_DISPATCH_LIMIT) {
+        return dispatch_switch<Count>(index, std::forward<F>(f));
+    } else {
+        using table = index_table<F&&, std::make_index_sequence<Count>>;
+        return table::table[std::min(index, Count - 1)](std::forward<F>(f));
+    }
+}
 }  // namespace variant_util
 
+using variant_util::all_copy_constructible;
+using variant_util::all_nothrow_copy_assignable_v;
+using variant_util::all_nothrow_copy_constructible_v;
+using variant_util::all_nothrow_move_assignable_v;
+using variant_util::all_nothrow_move_constructible_v;
+using variant_util::all_nothrow_swappable_v;
+using variant_util::all_move_constructible;
+using variant_util::all_swappable;
+using variant_util::all_trivially_copy_assignable;
+using variant_util::all_trivially_copy_constructible;
+using variant_util::all_trivially_destructible;
+using variant_util::all_trivially_move_assignable;
+using variant_util::all_trivially_move_constructible;
 using variant_util::get_index_by_type_v;
 using variant_util::get_type_by_index_t;
+using variant_util::index_type_t;
 using variant_util::NPOS;
+using variant_util::valueless_index_v;
+
+// Alternative stored out of line: Variant<int, Boxed<Large>> holds a pointer
+// to a heap allocated Large rather than the Large itself, so it stays the
+// size of the other alternatives. Get, GetIf, holds_alternative and Visit
+// see the Large, not the box. Boxed<T> is complete even when T is not, which
+// lets a variant contain itself through a box, e.g. the children of a tree
+// node.
+//
+// Copies are deep; a move hands the allocation over and leaves the source
+// empty, after which it may only be assigned to or destroyed. Get on a
+// variant holding an empty box throws, GetIf returns nullptr, and anything
+// else that reaches the value asserts.
+//
+// The value is allocated with Allocator, and built with uses-allocator
+// construction unless Allocator is std::allocator: a Boxed with a
+// std::pmr::polymorphic_allocator puts a pmr container it holds on the same
+// memory resource. Boxed is itself a uses-allocator type, see
+// Variant::emplace(std::allocator_arg, ...) and the matching constructors.
+template <typename T, typename Allocator = std::allocator<T>>
+class Boxed {
+    using traits = typename std::allocator_traits<
+        Allocator>::template rebind_traits<T>;
+
+  public:
+    using allocator_type = typename traits::allocator_type;
+
+    template <typename... Args>
+        requires(!std::is_same_v<std::remove_cvref_t<Args>, Boxed> && ...) &&
+                (!std::is_same_v<std::remove_cvref_t<Args>,
+                                 std::allocator_arg_t> &&
+                 ...) &&
+                std::is_constructible_v<T, Args...>
+    constexpr explicit Boxed(Args&&... args)
+        : ptr_(make(std::forward<Args>(args)...)) {}
+
+    template <typename... Args>
+    constexpr Boxed(std::allocator_arg_t /*unused*/,
+                    const allocator_type& alloc, Args&&... args)
+        : alloc_(alloc), ptr_(make(std::forward<Args>(args)...)) {}
+
+    // A template, so that overload resolution for copies of Boxed does not
+    // need T to be complete, nor instantiate it when it is a template.
+    template <typename U>
+        requires std::is_same_v<std::remove_cvref_t<U>, T>
+    constexpr Boxed(U&& value) : ptr_(make(std::forward<U>(value))) {}
+
+    constexpr Boxed(const Boxed& other)
+        : alloc_(traits::select_on_container_copy_construction(other.alloc_)),
+          ptr_(other.ptr_ == nullptr ? nullptr : make(*other.ptr_)) {}
+
+    constexpr Boxed(Boxed&& other) noexcept
+        : alloc_(other.alloc_), ptr_(std::exchange(other.ptr_, nullptr)) {}
+
+    // Assigns into the existing allocation when there is one.
+    constexpr Boxed& operator=(const Boxed& other) {
+        if (this == &other) {
+            return *this;
+        }
+        if constexpr (traits::propagate_on_container_copy_assignment::value) {
+            if (alloc_ != other.alloc_) {
+                reset();
+                alloc_ = other.alloc_;
+            }
+        }
+        if (other.ptr_ == nullptr) {
+            reset();
+            return *this;
+        }
+        if constexpr (std::is_copy_assignable_v<T>) {
+            if (ptr_ != nullptr) {
+                *ptr_ = *other.ptr_;
+                return *this;
+            }
+        }
+        T* copy = make(*other.ptr_);
+        reset();
+        ptr_ = copy;
+        return *this;
+    }
+
+    // Takes the allocation over when this allocator can free it, and moves
+    // the value into memory of this allocator otherwise.
+    constexpr Boxed& operator=(Boxed&& other) noexcept(
+        traits::propagate_on_container_move_assignment::value ||
+        traits::is_always_equal::value) {
+        if (this == &other) {
+            return *this;
+        }
+        if constexpr (traits::propagate_on_container_move_assignment::value) {
+            reset();
+            alloc_ = other.alloc_;
+        } else if (alloc_ != other.alloc_ && other.ptr_ != nullptr) {
+            T* moved = make(std::move(*other.ptr_));
+            reset();
+            ptr_ = moved;
+            return *this;
+        } else {
+            reset();
+        }
+        ptr_ = std::exchange(other.ptr_, nullptr);
+        return *this;
+    }
+
+    constexpr ~Boxed() {
+        reset();
+    }
+
+    constexpr allocator_type get_allocator() const {
+        return alloc_;
+    }
+
+    // Whether a move has taken the value away.
+    constexpr bool valueless_after_move() const noexcept {
+        return ptr_ == nullptr;
+    }
+
+    constexpr T& operator*() {
+        assert(ptr_ != nullptr);
+        return *ptr_;
+    }
+
+    constexpr const T& operator*() const {
+        assert(ptr_ != nullptr);
+        return *ptr_;
+    }
+
+    constexpr T* operator->() {
+        assert(ptr_ != nullptr);
+        return ptr_;
+    }
+
+    constexpr const T* operator->() const {
+        assert(ptr_ != nullptr);
+        return ptr_;
+    }
+
+  private:
+    template <typename... Args>
+    constexpr T* make(Args&&... args) {
+        T* ptr = traits::allocate(alloc_, 1);
+        try {
+            if constexpr (std::is_same_v<allocator_type, std::allocator<T>>) {
+                std::construct_at(ptr, std::forward<Args>(args)...);
+            } else {
+                std::uninitialized_construct_using_allocator(
+                    ptr, alloc_, std::forward<Args>(args)...);
+            }
+        } catch (...) {
+            traits::deallocate(alloc_, ptr, 1);
+            throw;
+        }
+        return ptr;
+    }
+
+    constexpr void reset() {
+        if (ptr_ != nullptr) {
+            std::destroy_at(ptr_);
+            traits::deallocate(alloc_, ptr_, 1);
+            ptr_ = nullptr;
+        }
+    }
+
+    [[no_unique_address]] allocator_type alloc_;
+    T* ptr_;
+};
+
+namespace variant_util {
+template <typename T>
+struct unbox {
+    using type = T;
+};
+
+template <typename T, typename Allocator>
+struct unbox<Boxed<T, Allocator>> {
+    using type = T;
+};
+
+template <typename T, typename Allocator>
+struct unbox<const Boxed<T, Allocator>> {
+    using type = const T;
+};
+
+// The type an alternative is accessed as: T for Boxed<T>, itself otherwise.
+template <typename T>
+using unbox_t = typename unbox<T>::type;
+
+// Index of the alternative accessed as T, which may also be named by its
+// box.
+template <typename T, typename... Types>
+constexpr size_t alternative_index_v =
+    get_index_by_type_v<unbox_t<T>, unbox_t<Types>...>;
+
+// Whether T names exactly one alternative, as in place construction and
+// emplace by type require.
+template <typename T, typename... Types>
+constexpr bool unique_alternative_v =
+    (size_t{std::is_same_v<unbox_t<T>, unbox_t<Types>>} + ... + 0) == 1;
+
+// The boxed value of a Boxed alternative, with the value category of the
+// box; any other alternative as it is.
+template <typename T>
+constexpr decltype(auto) unbox_value(T&& value) {
+    if constexpr (std::is_same_v<unbox_t<std::remove_reference_t<T>>,
+                                 std::remove_reference_t<T>>) {
+        return std::forward<T>(value);
+    } else if constexpr (std::is_lvalue_reference_v<T>) {
+        return *value;
+    } else {
+        return std::move(*value);
+    }
+}
+
+// Whether value is a Boxed alternative whose value a move has taken.
+template <typename T>
+constexpr bool moved_from_box(const T& value) {
+    if constexpr (std::is_same_v<unbox_t<T>, T>) {
+        return false;
+    } else {
+        return value.valueless_after_move();
+    }
+}
+}  // namespace variant_util
+
+using variant_util::alternative_index_v;
+using variant_util::unbox_t;
 
 template <typename... Types>
 class Variant;
 
+// Never valueless policy of the variant type V. Under it, an exception from
+// the construction of a new alternative leaves the old one in place: a
+// construction that may throw is made into a temporary, which is moved into
+// the variant once it exists. valueless_by_exception() is then constantly
+// false, and neither Visit nor destruction checks for it. On by default when
+// every alternative is nothrow move constructible, which that last move
+// relies on; specialize to std::false_type to save the temporary instead.
+template <typename V>
+struct variant_never_valueless : std::false_type {};
+
+template <typename... Types>
+struct variant_never_valueless<Variant<Types...>>
+    : std::bool_constant<all_nothrow_move_constructible_v<Types...>> {};
+
+namespace variant_util {
+constexpr bool INSTRUMENTATION = VARIANT_INSTRUMENTATION;
+
+#if VARIANT_INSTRUMENTATION
+// The name of T as the compiler spells it in the signature of this function.
+template <typename T>
+std::string_view type_name() {
+    std::string_view name = __PRETTY_FUNCTION__;
+    size_t begin = name.find("T = ") + 4;
+    size_t end = name.find_first_of(";]", begin);
+    return name.substr(begin, end - begin);
+}
+
+// Every kind of counters ever used, for DumpVariantStats.
+struct stats_directory {
+    std::mutex mutex;
+    std::vector<void (*)(std::ostream&)> dumps;
+
+    static stats_directory& instance() {
+        static stats_directory directory;
+        return directory;
+    }
+};
+
+// The counters described by Counters, one set per thread. A thread only
+// ever writes its own set, so an increment is a relaxed load and store
+// rather than a locked read-modify-write. Sets of finished threads are
+// folded into retired.
+template <typename Counters>
+class counter_registry {
+  public:
+    static counter_registry& instance() {
+        static counter_registry registry;
+        return registry;
+    }
+
+    static void add(size_t counter) {
+        thread_local local_counters local;
+        std::atomic<uint64_t>& count = local.counts[counter];
+        count.store(count.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+    }
+
+    // Sums over all threads so far.
+    std::vector<uint64_t> totals() {
+        std::lock_guard lock(mutex_);
+        std::vector<uint64_t> sums = retired_;
+        for (const local_counters* local : live_) {
+            for (size_t i = 0; i < Counters::SIZE; ++i) {
+                sums[i] += local->counts[i].load(std::memory_order_relaxed);
+            }
+        }
+        return sums;
+    }
+
+  private:
+    struct local_counters {
+        std::unique_ptr<std::atomic<uint64_t>[]> counts =
+            std::make_unique<std::atomic<uint64_t>[]>(Counters::SIZE);
+
+        local_counters() {
+            counter_registry& registry = instance();
+            std::lock_guard lock(registry.mutex_);
+            registry.live_.push_back(this);
+        }
+
+        ~local_counters() {
+            counter_registry& registry = instance();
+            std::lock_guard lock(registry.mutex_);
+            for (size_t i = 0; i < Counters::SIZE; ++i) {
+                registry.retired_[i] +=
+                    counts[i].load(std::memory_order_relaxed);
+            }
+            std::erase(registry.live_, this);
+        }
+    };
+
+    counter_registry() : retired_(Counters::SIZE) {
+        stats_directory& directory = stats_directory::instance();
+        std::lock_guard lock(directory.mutex);
+        directory.dumps.push_back([](std::ostream& out) {
+            Counters::dump(out, instance().totals());
+        });
+    }
+
+    std::mutex mutex_;
+    std::vector<const local_counters*> live_;
+    std::vector<uint64_t> retired_;
+};
+#endif
+
+template <typename V>
+struct variant_counters;
+
+// Counters of Variant<Types...>. Transitions are indexed by rank, 0 for
+// valueless and index + 1 otherwise, from and to.
+template <typename... Types>
+struct variant_counters<Variant<Types...>> {
+    static constexpr size_t COUNT = sizeof...(Types);
+    static constexpr size_t TRANSITIONS = (COUNT + 1) * (COUNT + 1);
+    static constexpr size_t VALUELESS_EVENTS = TRANSITIONS + COUNT;
+    static constexpr size_t SIZE = VALUELESS_EVENTS + 1;
+
+    static constexpr size_t transition(size_t from_rank, size_t to_rank) {
+        return from_rank * (COUNT + 1) + to_rank;
+    }
+
+    static constexpr size_t get_failure(size_t index) {
+        return TRANSITIONS + index;
+    }
+
+#if VARIANT_INSTRUMENTATION
+    // By rank.
+    static const std::array<std::string_view, COUNT + 1>& names() {
+        static const std::array<std::string_view, COUNT + 1> names = {
+            "valueless", type_name<Types>()...};
+        return names;
+    }
+
+    static void dump(std::ostream& out, const std::vector<uint64_t>& totals) {
+        const auto& names = variant_counters::names();
+        out << type_name<Variant<Types...>>() << '\n';
+        for (size_t from = 0; from <= COUNT; ++from) {
+            for (size_t to = 0; to <= COUNT; ++to) {
+                if (uint64_t count = totals[transition(from, to)]) {
+                    out << "  " << names[from] << " -> " << names[to] << ": "
+                        << count << '\n';
+                }
+            }
+        }
+        for (size_t index = 0; index < COUNT; ++index) {
+            if (uint64_t count = totals[get_failure(index)]) {
+                out << "  failed Get<" << names[index + 1] << ">: " << count
+                    << '\n';
+            }
+        }
+        if (uint64_t count = totals[VALUELESS_EVENTS]) {
+            out << "  became valueless: " << count << '\n';
+        }
+    }
+#endif
+};
+
+// Counters of Visit over variants of types Vs, one per combination of
+// alternatives, in the order of the dispatch table.
+template <typename... Vs>
+struct visit_counters {
+    static constexpr size_t SIZE = (variant_counters<Vs>::COUNT * ...);
+
+    static constexpr size_t combination(const Vs&... vs) {
+        size_t flat = 0;
+        ((flat = flat * variant_counters<Vs>::COUNT + vs.index()), ...);
+        return flat;
+    }
+
+#if VARIANT_INSTRUMENTATION
+    static void dump(std::ostream& out, const std::vector<uint64_t>& totals) {
+        constexpr size_t radixes[] = {variant_counters<Vs>::COUNT...};
+        const std::string_view* names[] = {
+            variant_counters<Vs>::names().data() + 1 ...};
+        out << "Visit";
+        const char* separator = "(";
+        ((out << separator << type_name<Vs>(), separator = ", "), ...);
+        out << ")\n";
+        for (size_t flat = 0; flat < SIZE; ++flat) {
+            if (totals[flat] == 0) {
+                continue;
+            }
+            size_t indices[sizeof...(Vs)];
+            size_t rest = flat;
+            for (size_t pos = sizeof...(Vs); pos-- > 0;) {
+                indices[pos] = rest % radixes[pos];
+                rest /= radixes[pos];
+            }
+            out << "  ";
+            for (size_t pos = 0; pos < sizeof...(Vs); ++pos) {
+                out << (pos == 0 ? "(" : ", ") << names[pos][indices[pos]];
+            }
+            out << "): " << totals[flat] << '\n';
+        }
+    }
+#endif
+};
+
+// Instrumentation hooks. Nothing is counted in constant evaluation.
+template <typename V>
+constexpr void note_transition(size_t from_rank, size_t to_rank) {
+#if VARIANT_INSTRUMENTATION
+    if (!std::is_constant_evaluated()) {
+        using counters = variant_counters<V>;
+        counter_registry<counters>::add(
+            counters::transition(from_rank, to_rank));
+    }
+#else
+    (void)from_rank;
+    (void)to_rank;
+#endif
+}
+
+template <typename V>
+constexpr void note_get_failure(size_t index) {
+#if VARIANT_INSTRUMENTATION
+    if (!std::is_constant_evaluated()) {
+        using counters = variant_counters<V>;
+        counter_registry<counters>::add(counters::get_failure(index));
+    }
+#else
+    (void)index;
+#endif
+}
+
+template <typename... Vs>
+constexpr void note_visit(const Vs&... vs) {
+#if VARIANT_INSTRUMENTATION
+    if (!std::is_constant_evaluated() &&
+        !(vs.valueless_by_exception() || ...)) {
+        using counters = visit_counters<Vs...>;
+        counter_registry<counters>::add(counters::combination(vs...));
+    }
+#else
+    ((void)vs, ...);
+#endif
+}
+
+// Counts an exception that leaves the variant V valueless: the probe lives
+// across the construction of a new alternative, and is destroyed by the
+// unwinding when that construction throws.
+template <typename V>
+struct valueless_probe {
+#if VARIANT_INSTRUMENTATION
+    int exceptions =
+        std::is_constant_evaluated() ? 0 : std::uncaught_exceptions();
+
+    constexpr ~valueless_probe() {
+        if (!std::is_constant_evaluated() &&
+            std::uncaught_exceptions() > exceptions) {
+            counter_registry<variant_counters<V>>::add(
+                variant_counters<V>::VALUELESS_EVENTS);
+        }
+    }
+#endif
+};
+}  // namespace variant_util
+
 template <size_t Index, typename... Types>
-const auto& Get(const Variant<Types...>& v);
+constexpr const auto& Get(const Variant<Types...>& v);
 
 template <size_t Index, typename... Types>
-auto& Get(Variant<Types...>& v);
+constexpr auto& Get(Variant<Types...>& v);
 
 template <size_t Index, typename... Types>
-auto&& Get(Variant<Types...>&& v);
+constexpr auto&& Get(Variant<Types...>&& v);
 
 template <size_t Index, typename... Types>
-const auto&& Get(const Variant<Types...>&& v);
+constexpr const auto&& Get(const Variant<Types...>&& v);
 
 template <typename...>
 union VariadicUnion {
@@ -69,29 +924,45 @@ union VariadicUnion {
     void get() const {
         static_assert(Index == 0, "Invalid index or type!");
     }
-
-    template <size_t Index, typename T, typename... Args>
-    void put(Args&&... /*unused*/) {
-        static_assert(Index == 0, "Invalid index or type!");
-    }
-
-    template <size_t Index, typename T>
-    void assign(T&& /*unused*/) {
-        static_assert(Index == 0, "Invalid index or type!");
-    }
 };
 
+// Alternatives are created by constructing the whole union with
+// std::construct_at, which selects the member through in_place_index. This
+// activates the member in constant evaluation too, where placement new on a
+// nested member is not allowed.
 template <typename Head, typename... Tail>
 union VariadicUnion<Head, Tail...> {
     Head head;
     VariadicUnion<Tail...> tail;
 
-    VariadicUnion() {}
+    constexpr VariadicUnion() noexcept {}
+
+    // Declared explicitly because the user-declared destructor would
+    // otherwise suppress the implicit move members. Each one stays trivial
+    // when it is trivial for every alternative, and is deleted otherwise.
+    VariadicUnion(const VariadicUnion&) = default;
+    VariadicUnion(VariadicUnion&&) = default;
+    VariadicUnion& operator=(const VariadicUnion&) = default;
+    VariadicUnion& operator=(VariadicUnion&&) = default;
 
-    ~VariadicUnion() {}
+    template <typename... Args>
+    constexpr explicit VariadicUnion(std::in_place_index_t<0> /*unused*/,
+                                     Args&&... args)
+        : head(std::forward<Args>(args)...) {}
+
+    template <size_t Index, typename... Args>
+    constexpr explicit VariadicUnion(std::in_place_index_t<Index> /*unused*/,
+                                     Args&&... args)
+        : tail(std::in_place_index<Index - 1>, std::forward<Args>(args)...) {}
+
+    constexpr ~VariadicUnion()
+        requires all_trivially_destructible<Head, Tail...>
+    = default;
+
+    constexpr ~VariadicUnion() {}
 
     template <size_t Index>
-    const auto& get() const {
+    constexpr const auto& get() const {
         if constexpr (Index == 0) {
             return head;
         } else {
@@ -100,7 +971,7 @@ union VariadicUnion<Head, Tail...> {
     }
 
     template <size_t Index>
-    auto& get() {
+    constexpr auto& get() {
         if constexpr (Index == 0) {
             return head;
         } else {
@@ -108,42 +979,122 @@ union VariadicUnion<Head, Tail...> {
         }
     }
 
-    template <size_t Index, typename T, typename... Args>
-    void put(Args&&... args) {
-        if constexpr (std::is_same_v<T, Head>) {
-            new (const_cast<std::remove_const_t<Head>*>(std::launder(&head)))
-                Head(std::forward<Args>(args)...);
-        } else {
-            tail.template put<Index + 1, T>(std::forward<Args>(args)...);
-        }
+    // The union must not hold a live alternative.
+    template <size_t Index, typename... Args>
+    constexpr void put(Args&&... args) {
+        std::construct_at(this, std::in_place_index<Index>,
+                          std::forward<Args>(args)...);
     }
 
-    template <size_t Index, typename T>
-    void assign(const T& value) {
-        if constexpr (std::is_same_v<std::remove_reference_t<T>, Head>) {
-            head = value;
+    template <size_t Index>
+    constexpr void destroy() {
+        if constexpr (Index == 0) {
+            std::destroy_at(&head);
         } else {
-            tail.template assign<Index + 1, T>(value);
+            tail.template destroy<Index - 1>();
         }
     }
+};
 
-    template <size_t Index, typename T>
-    void assign(T&& value) {
-        if constexpr (std::is_same_v<std::remove_reference_t<T>, Head>) {
-            head = std::forward<T>(value);
-        } else {
-            tail.template assign<Index + 1, T>(std::forward<T>(value));
-        }
+// Single buffer sized and aligned for the largest alternative. Every access
+// is one cast, whatever the index, so neither instantiation depth nor
+// compile time grows with the position of the alternative.
+template <typename... Types>
+struct AlignedUnion {
+    alignas(Types...) std::byte buffer[std::max({sizeof(Types)...})];
+
+    AlignedUnion() noexcept {}
+
+    template <size_t Index>
+    const auto& get() const {
+        static_assert(Index < sizeof...(Types), "Invalid index or type!");
+        using T = get_type_by_index_t<Index, Types...>;
+        return *std::launder(reinterpret_cast<const T*>(buffer));
     }
 
-    template <typename T>
+    template <size_t Index>
+    auto& get() {
+        static_assert(Index < sizeof...(Types), "Invalid index or type!");
+        using T = get_type_by_index_t<Index, Types...>;
+        return *std::launder(reinterpret_cast<T*>(buffer));
+    }
+
+    // The buffer must not hold a live alternative.
+    template <size_t Index, typename... Args>
+    void put(Args&&... args) {
+        using T = get_type_by_index_t<Index, Types...>;
+        ::new (static_cast<void*>(buffer)) T(std::forward<Args>(args)...);
+    }
+
+    template <size_t Index>
     void destroy() {
-        if constexpr (std::is_same_v<T, Head>) {
-            head.~Head();
+        std::destroy_at(&get<Index>());
+    }
+};
+
+template <typename... Types>
+using variant_union_t =
+    std::conditional_t<(sizeof...(Types) > variant_util::FLAT_STORAGE_LIMIT),
+                       AlignedUnion<Types...>, VariadicUnion<Types...>>;
+
+// Active alternative and its index. Kept as the first base of Variant so
+// that it is alive before the VariantAlternative constructors write into it
+// and so that the defaulted (trivial) special members can copy it as a whole.
+template <typename... Types>
+struct VariantStorage {
+    using index_t = index_type_t<sizeof...(Types)>;
+    static constexpr index_t VALUELESS = valueless_index_v<sizeof...(Types)>;
+
+    // Leaves the storage alone, even when value-initialized as a base: it
+    // is written by the constructor of the variant, and zeroing it first
+    // would cost a memset of the largest alternative.
+    constexpr VariantStorage() noexcept {}
+
+    variant_union_t<Types...> storage;
+    index_t idx;
+};
+
+// Unchecked access to the alternative with the given index, keeping the
+// value category of the variant. For internal dispatch only, where the index
+// is already known to be active.
+struct VariantAccess {
+    template <size_t Index, typename V>
+    static constexpr decltype(auto) get(V&& v) {
+        return variant_util::unbox_value(raw<Index>(std::forward<V>(v)));
+    }
+
+    // The stored alternative itself, which for a Boxed alternative is the
+    // box rather than its value. Copies, moves and swaps of whole variants
+    // go through it, so that moving a box does not move the boxed value.
+    template <size_t Index, typename V>
+    static constexpr decltype(auto) raw(V&& v) {
+        if constexpr (std::is_lvalue_reference_v<V>) {
+            return (v.storage.template get<Index>());
         } else {
-            tail.template destroy<T>();
+            return std::move(v.storage.template get<Index>());
         }
     }
+
+    // The storage, at whose start every alternative lives. Its bytes may be
+    // read whichever alternative is active.
+    template <typename V>
+    static constexpr const void* storage_address(const V& v) {
+        return std::addressof(v.storage);
+    }
+
+    // Whether Index is active and, for a Boxed alternative, still has its
+    // value.
+    template <size_t Index, typename V>
+    static constexpr bool has(const V& v) {
+        return v.idx == Index && !variant_util::moved_from_box(raw<Index>(v));
+    }
+
+    // index() + 1 in the index type of the variant: valueless variants wrap
+    // around to 0, below all others.
+    template <typename V>
+    static constexpr auto rank(const V& v) {
+        return static_cast<decltype(v.idx)>(v.idx + 1);
+    }
 };
 
 template <typename T, typename... Types>
@@ -151,307 +1102,752 @@ struct VariantAlternative {
     using Derived = Variant<Types...>;
     static const size_t Index = get_index_by_type_v<T, Types...>;
 
-    VariantAlternative() {}
-
-    ~VariantAlternative() {}
+    VariantAlternative() = default;
 
     template <typename U = T>
         requires std::is_same_v<U, std::string>
-    VariantAlternative(const char* value) {
+    constexpr VariantAlternative(const char* value) {
         auto this_ptr = static_cast<Derived*>(this);
-        this_ptr->storage.template put<0, T>(value);
+        this_ptr->storage.template put<Index>(value);
         this_ptr->idx = Index;
     }
 
-    VariantAlternative(const T& value) {
+    constexpr VariantAlternative(const T& value) noexcept(
+        std::is_nothrow_copy_constructible_v<T>) {
         auto this_ptr = static_cast<Derived*>(this);
-        this_ptr->storage.template put<0, T>(value);
+        this_ptr->storage.template put<Index>(value);
         this_ptr->idx = Index;
     }
 
-    VariantAlternative(T&& value) {
+    constexpr VariantAlternative(T&& value) noexcept(
+        std::is_nothrow_move_constructible_v<T>) {
         auto this_ptr = static_cast<Derived*>(this);
-        this_ptr->storage.template put<0, T>(std::move(value));
+        this_ptr->storage.template put<Index>(std::move(value));
         this_ptr->idx = Index;
     }
 
-    VariantAlternative(const VariantAlternative& other) {
-        auto other_ptr = static_cast<const Derived*>(&other);
-        if (other_ptr->idx == Index) {
-            auto this_ptr = static_cast<Derived*>(this);
-            this_ptr->storage.template put<0, T>(
-                other_ptr->storage.template get<Index>());
-            this_ptr->idx = Index;
-        }
+    // A Boxed alternative is also constructed from the value it boxes.
+    template <typename U = T>
+        requires(!std::is_same_v<unbox_t<U>, U>)
+    constexpr VariantAlternative(const unbox_t<U>& value) {
+        auto this_ptr = static_cast<Derived*>(this);
+        this_ptr->storage.template put<Index>(value);
+        this_ptr->idx = Index;
     }
 
-    VariantAlternative(VariantAlternative&& other) {
-        auto other_ptr = static_cast<Derived*>(&other);
-        if (other_ptr->idx == Index) {
-            auto this_ptr = static_cast<Derived*>(this);
-            this_ptr->storage.template put<0, T>(
-                std::move(other_ptr->storage.template get<Index>()));
-            this_ptr->idx = Index;
-        }
+    template <typename U = T>
+        requires(!std::is_same_v<unbox_t<U>, U>)
+    constexpr VariantAlternative(unbox_t<U>&& value) {
+        auto this_ptr = static_cast<Derived*>(this);
+        this_ptr->storage.template put<Index>(std::move(value));
+        this_ptr->idx = Index;
     }
 
     template <typename U = T>
         requires std::is_same_v<U, std::string>
-    Derived& operator=(const char* value) {
+    constexpr Derived& operator=(const char* value) {
         auto this_ptr = static_cast<Derived*>(this);
         if (Index == this_ptr->idx) {
-            this_ptr->storage.template assign<0, T>(value);
+            this_ptr->storage.template get<Index>() = value;
         } else {
-            this_ptr->destroy();
-            this_ptr->storage.template put<0, T>(value);
-            this_ptr->idx = Index;
+            this_ptr->template replace<Index>(value);
         }
         return *this_ptr;
     }
 
-    Derived& operator=(const T& value) {
+    constexpr Derived& operator=(const T& value) noexcept(
+        std::is_nothrow_copy_constructible_v<T> &&
+        std::is_nothrow_copy_assignable_v<T>) {
         auto this_ptr = static_cast<Derived*>(this);
         if (Index == this_ptr->idx) {
-            this_ptr->storage.template assign<0, T>(value);
+            this_ptr->storage.template get<Index>() = value;
         } else {
-            this_ptr->destroy();
-            this_ptr->storage.template put<0, T>(value);
-            this_ptr->idx = Index;
+            this_ptr->template replace<Index>(value);
         }
         return *this_ptr;
     }
 
-    Derived& operator=(T&& value) {
+    constexpr Derived& operator=(T&& value) noexcept(
+        std::is_nothrow_move_constructible_v<T> &&
+        std::is_nothrow_move_assignable_v<T>) {
         auto this_ptr = static_cast<Derived*>(this);
         if (Index == this_ptr->idx) {
-            this_ptr->storage.template assign<0, T>(std::move(value));
+            this_ptr->storage.template get<Index>() = std::move(value);
         } else {
-            this_ptr->destroy();
-            this_ptr->storage.template put<0, T>(std::move(value));
-            this_ptr->idx = Index;
+            this_ptr->template replace<Index>(std::move(value));
         }
         return *this_ptr;
     }
 
-    template <typename... Args>
-    T& emplace(Args&&... args) {
-        auto this_ptr = static_cast<Derived*>(this);
-        try {
-            destroy();
-            this_ptr->storage.template put<0, T>(std::forward<Args>(args)...);
-            this_ptr->idx = Index;
-        } catch (...) {
-            this_ptr->idx = NPOS;
-            throw;
-        }
-        return this_ptr->storage.template get<Index>();
-    }
-
-    void assign(const VariantAlternative& other) {
-        auto other_ptr = static_cast<const Derived*>(&other);
-        if (Index != other_ptr->idx) {
-            return;
-        }
+    // Assigning a value to a Boxed alternative that is already active
+    // assigns into its box instead of allocating a new one.
+    template <typename U = T>
+        requires(!std::is_same_v<unbox_t<U>, U>)
+    constexpr Derived& operator=(const unbox_t<U>& value) {
         auto this_ptr = static_cast<Derived*>(this);
-        this_ptr->storage.template put<0, T>(Get<Index>(*other_ptr));
-        this_ptr->idx = Index;
-    }
-
-    void assign(VariantAlternative&& other) {
-        auto other_ptr = static_cast<Derived*>(&other);
-        if (Index != other_ptr->idx) {
-            return;
+        if (Index == this_ptr->idx) {
+            *this_ptr->storage.template get<Index>() = value;
+        } else {
+            this_ptr->template replace<Index>(value);
         }
-        auto this_ptr = static_cast<Derived*>(this);
-        this_ptr->storage.template put<0, T>(std::move(Get<Index>(*other_ptr)));
-        this_ptr->idx = Index;
+        return *this_ptr;
     }
 
-    void destroy() {
+    template <typename U = T>
+        requires(!std::is_same_v<unbox_t<U>, U>)
+    constexpr Derived& operator=(unbox_t<U>&& value) {
         auto this_ptr = static_cast<Derived*>(this);
-        if (this_ptr->idx == Index) {
-            this_ptr->storage.template destroy<T>();
+        if (Index == this_ptr->idx) {
+            *this_ptr->storage.template get<Index>() = std::move(value);
+        } else {
+            this_ptr->template replace<Index>(std::move(value));
         }
+        return *this_ptr;
     }
 };
 
 template <typename... Types>
-class Variant : VariantAlternative<Types, Types...>... {
+class Variant : VariantStorage<Types...>,
+                VariantAlternative<Types, Types...>... {
   private:
     template <typename T, typename... Ts>
     friend struct VariantAlternative;
 
+    friend struct VariantAccess;
+
     template <size_t Index, typename... Ts>
-    friend const auto& Get(const Variant<Ts...>& v);
+    friend constexpr const auto& Get(const Variant<Ts...>& v);
 
     template <size_t Index, typename... Ts>
-    friend auto& Get(Variant<Ts...>& v);
+    friend constexpr auto& Get(Variant<Ts...>& v);
 
     template <size_t Index, typename... Ts>
-    friend auto&& Get(Variant<Ts...>&& v);
+    friend constexpr auto&& Get(Variant<Ts...>&& v);
 
     template <size_t Index, typename... Ts>
-    friend const auto&& Get(const Variant<Ts...>&& v);
+    friend constexpr const auto&& Get(const Variant<Ts...>&& v);
 
     template <typename T, typename... Ts>
-    friend const T& Get(const Variant<Ts...>& v);
+    friend constexpr const unbox_t<T>& Get(const Variant<Ts...>& v);
 
     template <typename T, typename... Ts>
-    friend T& Get(Variant<Ts...>& v);
+    friend constexpr unbox_t<T>& Get(Variant<Ts...>& v);
 
     template <typename T, typename... Ts>
-    friend T&& Get(Variant<Ts...>&& v);
+    friend constexpr unbox_t<T>&& Get(Variant<Ts...>&& v);
 
     template <typename T, typename... Ts>
-    friend const T&& Get(const Variant<Ts...>&& v);
+    friend constexpr const unbox_t<T>&& Get(const Variant<Ts...>&& v);
 
     template <typename T, typename... Ts>
-    friend bool holds_alternative(Variant<Ts...>& v);
+    friend constexpr bool holds_alternative(const Variant<Ts...>& v);
+
+    using VariantStorage<Types...>::VALUELESS;
+    using VariantStorage<Types...>::storage;
+    using VariantStorage<Types...>::idx;
+
+    // The stored type of the alternative accessed as T.
+    template <typename T>
+    using stored_t = get_type_by_index_t<
+        alternative_index_v<std::remove_reference_t<T>, Types...>, Types...>;
+
+    template <size_t Index>
+    using indexed_t = get_type_by_index_t<Index, Types...>;
 
-    VariadicUnion<Types...> storage;
-    size_t idx;
+    static constexpr bool NEVER_VALUELESS =
+        variant_never_valueless<Variant>::value;
+    static_assert(!NEVER_VALUELESS ||
+                      all_nothrow_move_constructible_v<Types...>,
+                  "A never valueless variant must move without throwing!");
 
   public:
     using VariantAlternative<Types, Types...>::VariantAlternative...;
     using VariantAlternative<Types, Types...>::operator=...;
 
-    Variant() : idx(0) {
-        storage.template put<0, get_type_by_index_t<0, Types...>>();
+    constexpr Variant() noexcept(
+        std::is_nothrow_default_constructible_v<
+            get_type_by_index_t<0, Types...>>) {
+        storage.template put<0>();
+        idx = 0;
+    }
+
+    // In place construction: the alternative is built in the storage from
+    // args, with no temporary to copy or move, so it need not be movable.
+    // For a Boxed alternative, in_place_type may name the value type, and
+    // args construct the value in the box.
+    template <size_t Index, typename... Args>
+        requires(Index < sizeof...(Types)) &&
+                std::is_constructible_v<indexed_t<Index>, Args&&...>
+    constexpr explicit Variant(std::in_place_index_t<Index> /*unused*/,
+                               Args&&... args) noexcept(
+        std::is_nothrow_constructible_v<indexed_t<Index>, Args&&...>) {
+        storage.template put<Index>(std::forward<Args>(args)...);
+        idx = Index;
+    }
+
+    template <size_t Index, typename U, typename... Args>
+        requires(Index < sizeof...(Types)) &&
+                std::is_constructible_v<indexed_t<Index>,
+                                        std::initializer_list<U>&, Args&&...>
+    constexpr explicit Variant(
+        std::in_place_index_t<Index> /*unused*/, std::initializer_list<U> list,
+        Args&&... args) noexcept(std::is_nothrow_constructible_v<
+                                 indexed_t<Index>, std::initializer_list<U>&,
+                                 Args&&...>) {
+        storage.template put<Index>(list, std::forward<Args>(args)...);
+        idx = Index;
+    }
+
+    template <typename T, typename... Args>
+        requires variant_util::unique_alternative_v<T, Types...> &&
+                 std::is_constructible_v<stored_t<T>, Args&&...>
+    constexpr explicit Variant(std::in_place_type_t<T> /*unused*/,
+                               Args&&... args) noexcept(
+        std::is_nothrow_constructible_v<stored_t<T>, Args&&...>)
+        : Variant(std::in_place_index<alternative_index_v<T, Types...>>,
+                  std::forward<Args>(args)...) {}
+
+    template <typename T, typename U, typename... Args>
+        requires variant_util::unique_alternative_v<T, Types...> &&
+                 std::is_constructible_v<stored_t<T>,
+                                         std::initializer_list<U>&, Args&&...>
+    constexpr explicit Variant(
+        std::in_place_type_t<T> /*unused*/, std::initializer_list<U> list,
+        Args&&... args) noexcept(std::is_nothrow_constructible_v<
+                                 stored_t<T>, std::initializer_list<U>&,
+                                 Args&&...>)
+        : Variant(std::in_place_index<alternative_index_v<T, Types...>>, list,
+                  std::forward<Args>(args)...) {}
+
+    // Uses-allocator in place construction, with alloc passed on as
+    // emplace(std::allocator_arg, ...) does.
+    template <size_t Index, typename Allocator, typename... Args>
+        requires(Index < sizeof...(Types))
+    constexpr Variant(std::allocator_arg_t /*unused*/, const Allocator& alloc,
+                      std::in_place_index_t<Index> /*unused*/,
+                      Args&&... args) {
+        std::apply(
+            [this](auto&&... ctor_args) {
+                storage.template put<Index>(
+                    std::forward<decltype(ctor_args)>(ctor_args)...);
+            },
+            std::uses_allocator_construction_args<
+                std::remove_cv_t<indexed_t<Index>>>(
+                alloc, std::forward<Args>(args)...));
+        idx = Index;
     }
 
+    template <typename T, typename Allocator, typename... Args>
+        requires variant_util::unique_alternative_v<T, Types...>
+    constexpr Variant(std::allocator_arg_t tag, const Allocator& alloc,
+                      std::in_place_type_t<T> /*unused*/, Args&&... args)
+        : Variant(tag, alloc,
+                  std::in_place_index<alternative_index_v<T, Types...>>,
+                  std::forward<Args>(args)...) {}
+
     Variant(const Variant& other)
-        : VariantAlternative<Types, Types...>(other)... {};
+        requires all_trivially_copy_constructible<Types...>
+    = default;
+
+    constexpr Variant(const Variant& other) noexcept(
+        all_nothrow_copy_constructible_v<Types...>)
+        requires all_copy_constructible<Types...>
+        : VariantStorage<Types...>(), VariantAlternative<Types, Types...>()... {
+        construct_from(other);
+    }
 
     Variant(Variant&& other)
-        : VariantAlternative<Types, Types...>(std::move(other))... {};
+        requires all_trivially_move_constructible<Types...>
+    = default;
+
+    constexpr Variant(Variant&& other) noexcept(
+        all_nothrow_move_constructible_v<Types...>)
+        requires all_move_constructible<Types...>
+        : VariantStorage<Types...>(), VariantAlternative<Types, Types...>()... {
+        construct_from(std::move(other));
+    }
+
+    ~Variant()
+        requires all_trivially_destructible<Types...>
+    = default;
 
-    ~Variant() {
+    constexpr ~Variant() noexcept(
+        (std::is_nothrow_destructible_v<Types> && ...)) {
         destroy();
     }
 
-    Variant& operator=(const Variant& other) {
-        destroy();
-        (VariantAlternative<Types, Types...>::assign(other), ...);
+    Variant& operator=(const Variant& other)
+        requires all_trivially_copy_assignable<Types...>
+    = default;
+
+    constexpr Variant& operator=(const Variant& other) noexcept(
+        all_nothrow_copy_assignable_v<Types...>)
+        requires all_copy_constructible<Types...>
+    {
+        assign_from(other);
         return *this;
     }
 
-    Variant& operator=(Variant&& other) {
-        destroy();
-        (VariantAlternative<Types, Types...>::assign(std::move(other)), ...);
+    Variant& operator=(Variant&& other)
+        requires all_trivially_move_assignable<Types...>
+    = default;
+
+    constexpr Variant& operator=(Variant&& other) noexcept(
+        all_nothrow_move_assignable_v<Types...>)
+        requires all_move_constructible<Types...>
+    {
+        assign_from(std::move(other));
         return *this;
     }
 
+    // T names the alternative as it is accessed, so the boxed type for a
+    // Boxed alternative, which is still constructed in its box.
     template <typename T, typename... Args>
-    T& emplace(Args&&... args) {
+        requires variant_util::unique_alternative_v<std::remove_reference_t<T>,
+                                                    Types...> &&
+                 (!variant_util::leading_allocator_arg_v<Args...>)
+    constexpr unbox_t<T>& emplace(Args&&... args) noexcept(
+        std::is_nothrow_constructible_v<stored_t<T>, Args&&...>) {
         constexpr size_t new_idx =
-            get_index_by_type_v<std::remove_reference_t<T>, Types...>;
-        try {
-            destroy();
-            storage.template put<0, T>(std::forward<Args>(args)...);
-            idx = new_idx;
-        } catch (...) {
-            idx = NPOS;
-            throw;
-        }
-        return storage.template get<new_idx>();
+            alternative_index_v<std::remove_reference_t<T>, Types...>;
+        replace<new_idx>(std::forward<Args>(args)...);
+        return VariantAccess::get<new_idx>(*this);
     }
 
     template <size_t Index, typename... Args>
-    auto& emplace(Args&&... args) {
+        requires(Index < sizeof...(Types)) &&
+                (!variant_util::leading_allocator_arg_v<Args...>)
+    constexpr auto& emplace(Args&&... args) noexcept(
+        std::is_nothrow_constructible_v<get_type_by_index_t<Index, Types...>,
+                                        Args&&...>) {
         return emplace<get_type_by_index_t<Index, Types...>>(
             std::forward<Args>(args)...);
     }
 
     template <typename T, typename U, typename... Args>
-    T& emplace(std::initializer_list<U> list, Args&&... args) {
+        requires variant_util::unique_alternative_v<std::remove_reference_t<T>,
+                                                    Types...>
+    constexpr unbox_t<T>& emplace(
+        std::initializer_list<U> list,
+        Args&&... args) noexcept(std::is_nothrow_constructible_v<
+                                 stored_t<T>, std::initializer_list<U>&,
+                                 Args&&...>) {
         constexpr size_t new_idx =
-            get_index_by_type_v<std::remove_reference_t<T>, Types...>;
-        try {
-            destroy();
-            storage.template put<0, T>(list, std::forward<Args>(args)...);
-            idx = new_idx;
-        } catch (...) {
-            idx = NPOS;
-            throw;
-        }
-        return storage.template get<new_idx>();
+            alternative_index_v<std::remove_reference_t<T>, Types...>;
+        replace<new_idx>(list, std::forward<Args>(args)...);
+        return VariantAccess::get<new_idx>(*this);
     }
 
     template <size_t Index, typename U, typename... Args>
-    auto& emplace(std::initializer_list<U> list, Args&&... args) {
+        requires(Index < sizeof...(Types))
+    constexpr auto& emplace(
+        std::initializer_list<U> list,
+        Args&&... args) noexcept(std::is_nothrow_constructible_v<
+                                 get_type_by_index_t<Index, Types...>,
+                                 std::initializer_list<U>&, Args&&...>) {
         return emplace<get_type_by_index_t<Index, Types...>>(
             list, std::forward<Args>(args)...);
     }
 
+    // Uses-allocator construction: alloc is passed to the new alternative
+    // when it takes one, leading with std::allocator_arg or trailing, and
+    // dropped otherwise. A Boxed alternative allocates its value with alloc,
+    // and hands it on to the value in turn.
+    template <typename T, typename Allocator, typename... Args>
+        requires variant_util::unique_alternative_v<std::remove_reference_t<T>,
+                                                    Types...>
+    constexpr unbox_t<T>& emplace(std::allocator_arg_t /*unused*/,
+                                  const Allocator& alloc, Args&&... args) {
+        constexpr size_t new_idx =
+            alternative_index_v<std::remove_reference_t<T>, Types...>;
+        std::apply(
+            [this](auto&&... ctor_args) {
+                replace<new_idx>(
+                    std::forward<decltype(ctor_args)>(ctor_args)...);
+            },
+            std::uses_allocator_construction_args<
+                std::remove_cv_t<stored_t<T>>>(alloc,
+                                               std::forward<Args>(args)...));
+        return VariantAccess::get<new_idx>(*this);
+    }
+
+    template <size_t Index, typename Allocator, typename... Args>
+        requires(Index < sizeof...(Types))
+    constexpr auto& emplace(std::allocator_arg_t tag, const Allocator& alloc,
+                            Args&&... args) {
+        return emplace<get_type_by_index_t<Index, Types...>>(
+            tag, alloc, std::forward<Args>(args)...);
+    }
+
     constexpr size_t index() const {
-        return idx;
+        if constexpr (NEVER_VALUELESS) {
+            return idx;
+        } else {
+            return idx == VALUELESS ? NPOS : idx;
+        }
     }
 
-    bool valueless_by_exception() const {
-        return idx == NPOS;
+    constexpr bool valueless_by_exception() const {
+        return !NEVER_VALUELESS && idx == VALUELESS;
+    }
+
+    // Swaps the alternatives themselves when both sides hold the same one,
+    // and moves through a temporary otherwise.
+    constexpr void swap(Variant& other) noexcept(
+        all_nothrow_swappable_v<Types...>)
+        requires all_move_constructible<Types...> && all_swappable<Types...>
+    {
+        if (idx != other.idx) {
+            Variant tmp(std::move(other));
+            other.assign_from(std::move(*this));
+            assign_from(std::move(tmp));
+            return;
+        }
+        if (valueless_by_exception()) {
+            return;
+        }
+        variant_util::dispatch_index<sizeof...(Types)>(idx, [&](auto index) {
+            using std::swap;
+            swap(storage.template get<index>(),
+                 other.storage.template get<index>());
+        });
     }
 
   private:
-    void destroy() {
-        (VariantAlternative<Types, Types...>::destroy(), ...);
+    // Copies or moves, following the value category of other, its active
+    // alternative into the storage of this variant, which must be empty.
+    template <typename V>
+    constexpr void construct_from(V&& other) {
+        idx = VALUELESS;
+        if (other.valueless_by_exception()) {
+            return;
+        }
+        variant_util::dispatch_index<sizeof...(Types)>(
+            other.idx, [&](auto index) {
+                storage.template put<index>(
+                    VariantAccess::raw<index>(std::forward<V>(other)));
+            });
+        idx = other.idx;
+    }
+
+    // Assigns in place when both sides hold the same alternative, keeping
+    // whatever the destination already owns (string or vector capacity).
+    // Alternatives that are not assignable, e.g. const ones, and alternative
+    // changes go through reconstruct.
+    template <typename V>
+    constexpr void assign_from(V&& other) {
+        if (idx != other.idx || valueless_by_exception()) {
+            size_t from = VariantAccess::rank(*this);
+            reconstruct_from(std::forward<V>(other));
+            variant_util::note_transition<Variant>(from,
+                                                   VariantAccess::rank(*this));
+            return;
+        }
+        variant_util::dispatch_index<sizeof...(Types)>(idx, [&](auto index) {
+            auto&& source = VariantAccess::raw<index>(std::forward<V>(other));
+            auto& target = storage.template get<index>();
+            if constexpr (std::is_assignable_v<decltype(target),
+                                               decltype(source)>) {
+                target = std::forward<decltype(source)>(source);
+            } else if (this != &other) {
+                reconstruct_from(std::forward<V>(other));
+            }
+        });
+    }
+
+    // Destroys the active alternative and constructs that of other in its
+    // place, through a temporary when the variant is never valueless and
+    // the copy may throw.
+    template <typename V>
+    constexpr void reconstruct_from(V&& other) {
+        if constexpr (NEVER_VALUELESS &&
+                      !std::is_nothrow_constructible_v<Variant, V&&>) {
+            Variant tmp(std::forward<V>(other));
+            destroy();
+            construct_from(std::move(tmp));
+        } else {
+            [[maybe_unused]] variant_util::valueless_probe<Variant> probe;
+            destroy();
+            construct_from(std::forward<V>(other));
+        }
+    }
+
+    // Destroys the active alternative and constructs the alternative Index
+    // from args in its place. The variant is valueless in between, so that
+    // an exception from the constructor leaves it valueless, unless it is
+    // never valueless: a constructor that may throw then runs first, on a
+    // temporary.
+    template <size_t Index, typename... Args>
+    constexpr void replace(Args&&... args) {
+        using T = indexed_t<Index>;
+        if constexpr (NEVER_VALUELESS &&
+                      !std::is_nothrow_constructible_v<T, Args&&...>) {
+            T tmp(std::forward<Args>(args)...);
+            replace<Index>(std::move(tmp));
+        } else {
+            [[maybe_unused]] variant_util::valueless_probe<Variant> probe;
+            size_t from = VariantAccess::rank(*this);
+            destroy();
+            idx = VALUELESS;
+            storage.template put<Index>(std::forward<Args>(args)...);
+            idx = Index;
+            variant_util::note_transition<Variant>(from, Index + 1);
+        }
+    }
+
+    // Destroys the active alternative only: one indexed dispatch, or nothing
+    // at all when every alternative is trivially destructible.
+    constexpr void destroy() {
+        if constexpr (!all_trivially_destructible<Types...>) {
+            if (valueless_by_exception()) {
+                return;
+            }
+            variant_util::dispatch_index<sizeof...(Types)>(
+                idx, [this](auto index) {
+                    storage.template destroy<index>();
+                });
+        }
     }
 };
 
 template <size_t Index, typename... Types>
-const auto& Get(const Variant<Types...>& v) {
-    if (v.idx != Index) {
-        throw std::runtime_error("Bad variant access!");
+constexpr const auto& Get(const Variant<Types...>& v) {
+    if (!VariantAccess::has<Index>(v)) [[unlikely]] {
+        variant_util::note_get_failure<Variant<Types...>>(Index);
+        variant_util::throw_bad_variant_access();
     }
-    return v.storage.template get<Index>();
+    return VariantAccess::get<Index>(v);
 }
 
 template <size_t Index, typename... Types>
-auto& Get(Variant<Types...>& v) {
-    if (v.idx != Index) {
-        throw std::runtime_error("Bad variant access!");
+constexpr auto& Get(Variant<Types...>& v) {
+    if (!VariantAccess::has<Index>(v)) [[unlikely]] {
+        variant_util::note_get_failure<Variant<Types...>>(Index);
+        variant_util::throw_bad_variant_access();
     }
-    return v.storage.template get<Index>();
+    return VariantAccess::get<Index>(v);
 }
 
 template <size_t Index, typename... Types>
-auto&& Get(Variant<Types...>&& v) {
-    if (v.idx != Index) {
-        throw std::runtime_error("Bad variant access!");
+constexpr auto&& Get(Variant<Types...>&& v) {
+    if (!VariantAccess::has<Index>(v)) [[unlikely]] {
+        variant_util::note_get_failure<Variant<Types...>>(Index);
+        variant_util::throw_bad_variant_access();
     }
-    return std::move(v.storage.template get<Index>());
+    return VariantAccess::get<Index>(std::move(v));
 }
 
 template <size_t Index, typename... Types>
-const auto&& Get(const Variant<Types...>&& v) {
-    if (v.idx != Index) {
-        throw std::runtime_error("Bad variant access!");
+constexpr const auto&& Get(const Variant<Types...>&& v) {
+    if (!VariantAccess::has<Index>(v)) [[unlikely]] {
+        variant_util::note_get_failure<Variant<Types...>>(Index);
+        variant_util::throw_bad_variant_access();
     }
-    return std::move(v.storage.template get<Index>());
+    return VariantAccess::get<Index>(std::move(v));
+}
+
+template <typename T, typename... Types>
+constexpr const unbox_t<T>& Get(const Variant<Types...>& v) {
+    return Get<alternative_index_v<T, Types...>>(v);
+}
+
+template <typename T, typename... Types>
+constexpr unbox_t<T>& Get(Variant<Types...>& v) {
+    return Get<alternative_index_v<T, Types...>>(v);
+}
+
+template <typename T, typename... Types>
+constexpr unbox_t<T>&& Get(Variant<Types...>&& v) {
+    return std::move(Get<alternative_index_v<T, Types...>>(std::move(v)));
 }
 
 template <typename T, typename... Types>
-const T& Get(const Variant<Types...>& v) {
-    return Get<get_index_by_type_v<T, Types...>>(v);
+constexpr const unbox_t<T>&& Get(const Variant<Types...>&& v) {
+    return std::move(Get<alternative_index_v<T, Types...>>(std::move(v)));
+}
+
+// Access without the index check, for callers that have already tested
+// index(). Holding another alternative is checked only in debug builds.
+template <size_t Index, typename... Types>
+constexpr const auto& UncheckedGet(const Variant<Types...>& v) {
+    assert(v.index() == Index);
+    return VariantAccess::get<Index>(v);
+}
+
+template <size_t Index, typename... Types>
+constexpr auto& UncheckedGet(Variant<Types...>& v) {
+    assert(v.index() == Index);
+    return VariantAccess::get<Index>(v);
+}
+
+template <size_t Index, typename... Types>
+constexpr auto&& UncheckedGet(Variant<Types...>&& v) {
+    assert(v.index() == Index);
+    return VariantAccess::get<Index>(std::move(v));
+}
+
+template <size_t Index, typename... Types>
+constexpr const auto&& UncheckedGet(const Variant<Types...>&& v) {
+    assert(v.index() == Index);
+    return VariantAccess::get<Index>(std::move(v));
 }
 
 template <typename T, typename... Types>
-T& Get(Variant<Types...>& v) {
-    return Get<get_index_by_type_v<T, Types...>>(v);
+constexpr const unbox_t<T>& UncheckedGet(const Variant<Types...>& v) {
+    return UncheckedGet<alternative_index_v<T, Types...>>(v);
 }
 
 template <typename T, typename... Types>
-T&& Get(Variant<Types...>&& v) {
-    return std::move(Get<get_index_by_type_v<T, Types...>>(std::move(v)));
+constexpr unbox_t<T>& UncheckedGet(Variant<Types...>& v) {
+    return UncheckedGet<alternative_index_v<T, Types...>>(v);
 }
 
 template <typename T, typename... Types>
-const T&& Get(const Variant<Types...>&& v) {
-    return std::move(Get<get_index_by_type_v<T, Types...>>(std::move(v)));
+constexpr unbox_t<T>&& UncheckedGet(Variant<Types...>&& v) {
+    return UncheckedGet<alternative_index_v<T, Types...>>(std::move(v));
 }
 
 template <typename T, typename... Types>
-bool holds_alternative(Variant<Types...>& v) {
-    return get_index_by_type_v<T, Types...> == v.idx;
+constexpr const unbox_t<T>&& UncheckedGet(const Variant<Types...>&& v) {
+    return UncheckedGet<alternative_index_v<T, Types...>>(std::move(v));
+}
+
+// Pointer to the alternative, or nullptr when v is null, holds another one
+// or holds a box emptied by a move. Never throws.
+template <size_t Index, typename... Types>
+constexpr std::add_pointer_t<unbox_t<get_type_by_index_t<Index, Types...>>>
+GetIf(Variant<Types...>* v) noexcept {
+    if (v == nullptr || !VariantAccess::has<Index>(*v)) {
+        return nullptr;
+    }
+    return std::addressof(VariantAccess::get<Index>(*v));
+}
+
+template <size_t Index, typename... Types>
+constexpr std::add_pointer_t<
+    const unbox_t<get_type_by_index_t<Index, Types...>>>
+GetIf(const Variant<Types...>* v) noexcept {
+    if (v == nullptr || !VariantAccess::has<Index>(*v)) {
+        return nullptr;
+    }
+    return std::addressof(VariantAccess::get<Index>(*v));
+}
+
+template <typename T, typename... Types>
+constexpr std::add_pointer_t<unbox_t<T>> GetIf(Variant<Types...>* v) noexcept {
+    return GetIf<alternative_index_v<T, Types...>>(v);
+}
+
+template <typename T, typename... Types>
+constexpr std::add_pointer_t<const unbox_t<T>> GetIf(
+    const Variant<Types...>* v) noexcept {
+    return GetIf<alternative_index_v<T, Types...>>(v);
+}
+
+template <typename T, typename... Types>
+constexpr bool holds_alternative(const Variant<Types...>& v) {
+    return alternative_index_v<T, Types...> == v.idx;
+}
+
+template <typename... Types>
+    requires all_move_constructible<Types...> && all_swappable<Types...>
+constexpr void swap(Variant<Types...>& lhs,
+                    Variant<Types...>& rhs) noexcept(noexcept(lhs.swap(rhs))) {
+    lhs.swap(rhs);
+}
+
+namespace variant_util {
+// Boxed alternatives are compared by their values.
+template <typename T, typename Op>
+concept comparable_by = requires(const unbox_t<T>& a, Op op) {
+    { op(a, a) } -> std::convertible_to<bool>;
+};
+
+// Variants are ordered by index() first, with the valueless ones before all
+// others, then by the values of the alternative they share. That alternative
+// is the only one dispatched on, so comparing two variants of scalars is an
+// index compare and a switch of plain compares instead of a visit of every
+// pair of alternatives.
+template <typename Op, typename... Types>
+constexpr bool compare(const Variant<Types...>& v, const Variant<Types...>& w,
+                       Op op) {
+    auto v_rank = VariantAccess::rank(v);
+    auto w_rank = VariantAccess::rank(w);
+    if (v_rank != w_rank) {
+        return op(v_rank, w_rank);
+    }
+    if (v_rank == 0) {
+        // Two valueless variants compare equal.
+        return op(0, 0);
+    }
+    return dispatch_index<sizeof...(Types)>(v_rank - 1, [&](auto index) {
+        return static_cast<bool>(
+            op(UncheckedGet<index>(v), UncheckedGet<index>(w)));
+    });
+}
+}  // namespace variant_util
+
+template <typename... Types>
+    requires(variant_util::comparable_by<Types, std::equal_to<>> && ...)
+constexpr bool operator==(const Variant<Types...>& v,
+                          const Variant<Types...>& w) {
+    return variant_util::compare(v, w, std::equal_to<>());
+}
+
+template <typename... Types>
+    requires(variant_util::comparable_by<Types, std::not_equal_to<>> && ...)
+constexpr bool operator!=(const Variant<Types...>& v,
+                          const Variant<Types...>& w) {
+    return variant_util::compare(v, w, std::not_equal_to<>());
+}
+
+template <typename... Types>
+    requires(variant_util::comparable_by<Types, std::less<>> && ...)
+constexpr bool operator<(const Variant<Types...>& v,
+                         const Variant<Types...>& w) {
+    return variant_util::compare(v, w, std::less<>());
+}
+
+template <typename... Types>
+    requires(variant_util::comparable_by<Types, std::greater<>> && ...)
+constexpr bool operator>(const Variant<Types...>& v,
+                         const Variant<Types...>& w) {
+    return variant_util::compare(v, w, std::greater<>());
+}
+
+template <typename... Types>
+    requires(variant_util::comparable_by<Types, std::less_equal<>> && ...)
+constexpr bool operator<=(const Variant<Types...>& v,
+                          const Variant<Types...>& w) {
+    return variant_util::compare(v, w, std::less_equal<>());
+}
+
+template <typename... Types>
+    requires(variant_util::comparable_by<Types, std::greater_equal<>> && ...)
+constexpr bool operator>=(const Variant<Types...>& v,
+                          const Variant<Types...>& w) {
+    return variant_util::compare(v, w, std::greater_equal<>());
+}
+
+template <typename... Types>
+    requires(std::three_way_comparable<unbox_t<Types>> && ...)
+constexpr std::common_comparison_category_t<
+    std::compare_three_way_result_t<unbox_t<Types>>...>
+operator<=>(const Variant<Types...>& v, const Variant<Types...>& w) {
+    using result_t = std::common_comparison_category_t<
+        std::compare_three_way_result_t<unbox_t<Types>>...>;
+    auto v_rank = VariantAccess::rank(v);
+    auto w_rank = VariantAccess::rank(w);
+    if (v_rank != w_rank) {
+        return v_rank <=> w_rank;
+    }
+    if (v_rank == 0) {
+        return std::strong_ordering::equal;
+    }
+    return variant_util::dispatch_index<sizeof...(Types)>(
+        v_rank - 1, [&](auto index) -> result_t {
+            return UncheckedGet<index>(v) <=> UncheckedGet<index>(w);
+        });
 }
 
 template <typename T>
@@ -464,63 +1860,359 @@ struct variant_size<Variant<Types...>> {
     static const size_t value = sizeof...(Types);
 };
 
-// https://stackoverflow.com/a/50944602
-template <typename Dest = void, typename... Arg>
-constexpr auto make_array(Arg&&... arg) {
-    if constexpr (std::is_same<void, Dest>::value) {
-        return std::array<std::common_type_t<std::decay_t<Arg>...>,
-                          sizeof...(Arg)>{{std::forward<Arg>(arg)...}};
-    } else {
-        return std::array<Dest, sizeof...(Arg)>{{std::forward<Arg>(arg)...}};
+// https://mpark.github.io/programming/2015/07/07/variant-visitation/
+//
+// The table is flat: the combination of indices (i_0, ..., i_k) is stored at
+// the mixed-radix position ((i_0 * n_1 + i_1) * n_2 + ...) * n_k + i_k,
+// where n_j is the number of alternatives of the j-th variant. Entries are
+// computed by class templates rather than constexpr functions, so the only
+// functions instantiated per combination are the dispatchers themselves.
+template <typename F, typename... Vs>
+struct fmatrix_layout {
+    static constexpr size_t radixes[] = {
+        variant_size<std::decay_t<Vs>>::value...};
+    static constexpr size_t size =
+        (variant_size<std::decay_t<Vs>>::value * ...);
+
+    static constexpr size_t index(const Vs&... vs) {
+        size_t flat = 0;
+        ((flat = flat * variant_size<std::decay_t<Vs>>::value + vs.index()),
+         ...);
+        return flat;
     }
-}
 
-// https://mpark.github.io/programming/2015/07/07/variant-visitation/
-template <typename F, typename... Vs, size_t... Is>
-constexpr auto make_fmatrix_impl(std::index_sequence<Is...> /*unused*/) {
-    struct dispatcher {
+    // Index of the Pos-th variant encoded in the flat position Flat.
+    template <size_t Flat, size_t Pos>
+    static constexpr size_t digit = [] {
+        size_t weight = 1;
+        for (size_t i = Pos + 1; i < sizeof...(Vs); ++i) {
+            weight *= radixes[i];
+        }
+        return Flat / weight % radixes[Pos];
+    }();
+
+    template <size_t Flat, typename Pos = std::index_sequence_for<Vs...>>
+    struct combination;
+
+    template <size_t Flat, size_t... Pos>
+    struct combination<Flat, std::index_sequence<Pos...>> {
+        using type = std::index_sequence<digit<Flat, Pos>...>;
+    };
+
+    template <size_t Flat>
+    using combination_t = typename combination<Flat>::type;
+
+    // The table lookup has already selected the active alternatives, so
+    // the dispatcher neither checks them again nor goes through std::invoke
+    // unless it has to: both would be repeated for every combination.
+    template <typename Is>
+    struct dispatcher;
+
+    template <size_t... Is>
+    struct dispatcher<std::index_sequence<Is...>> {
         static constexpr decltype(auto) dispatch(F&& f, Vs&&... vs) {
-            return std::invoke(static_cast<F>(f),
-                               Get<Is>(static_cast<Vs>(vs))...);
+            if constexpr (std::is_member_pointer_v<std::decay_t<F>>) {
+                return std::invoke(
+                    static_cast<F>(f),
+                    VariantAccess::get<Is>(static_cast<Vs>(vs))...);
+            } else {
+                return static_cast<F>(f)(
+                    VariantAccess::get<Is>(static_cast<Vs>(vs))...);
+            }
         }
     };
-    return &dispatcher::dispatch;
+
+    template <typename Is>
+    struct handles;
+
+    template <size_t... Is>
+    struct handles<std::index_sequence<Is...>>
+        : std::is_invocable<F, decltype(Get<Is>(std::declval<Vs>()))...> {};
+};
+
+template <typename F, typename... Vs>
+struct fmatrix : fmatrix_layout<F, Vs...> {
+    using layout = fmatrix_layout<F, Vs...>;
+
+    template <size_t... Flat>
+    static constexpr auto make(std::index_sequence<Flat...> /*unused*/) {
+        return std::array{&layout::template dispatcher<
+            typename layout::template combination_t<Flat>>::dispatch...};
+    }
+
+    static constexpr auto table =
+        make(std::make_index_sequence<layout::size>{});
+};
+
+// Same layout as fmatrix, but combinations the visitor cannot be invoked
+// with share a single throwing entry instead of instantiating a dispatcher
+// each.
+template <typename F, typename... Vs>
+struct partial_fmatrix : fmatrix_layout<F, Vs...> {
+    using layout = fmatrix_layout<F, Vs...>;
+
+    template <size_t Flat>
+    static constexpr bool handled = layout::template handles<
+        typename layout::template combination_t<Flat>>::value;
+
+    template <size_t... Flat>
+    static constexpr size_t first_handled(
+        std::index_sequence<Flat...> /*unused*/) {
+        constexpr bool handled_flags[] = {handled<Flat>...};
+        return std::find(std::begin(handled_flags), std::end(handled_flags),
+                         true) -
+               std::begin(handled_flags);
+    }
+
+    static constexpr size_t first =
+        first_handled(std::make_index_sequence<layout::size>{});
+    static_assert(first < layout::size,
+                  "Visitor handles no combination of alternatives!");
+
+    using dispatch_t = decltype(&layout::template dispatcher<
+                                typename layout::template combination_t<
+                                    first>>::dispatch);
+    using result_t = std::invoke_result_t<dispatch_t, F&&, Vs&&...>;
+
+    static constexpr result_t unhandled(F&& /*unused*/, Vs&&... /*unused*/) {
+        throw std::runtime_error("Unhandled variant combination!");
+    }
+
+    template <size_t Flat, bool = handled<Flat>>
+    struct entry {
+        static constexpr dispatch_t value = &layout::template dispatcher<
+            typename layout::template combination_t<Flat>>::dispatch;
+    };
+
+    template <size_t Flat>
+    struct entry<Flat, false> {
+        static constexpr dispatch_t value = &unhandled;
+    };
+
+    template <size_t... Flat>
+    static constexpr auto make(std::index_sequence<Flat...> /*unused*/) {
+        return std::array{entry<Flat>::value...};
+    }
+
+    static constexpr auto table =
+        make(std::make_index_sequence<layout::size>{});
+};
+
+namespace variant_util {
+// Visit, without the hint of variant_likely_alternative. Visiting a
+// valueless variant throws; the check is constant false, and costs nothing,
+// for never valueless variants.
+template <typename F, typename... Vs>
+constexpr decltype(auto) dispatch_visit(F&& f, Vs&&... vs) {
+    if ((vs.valueless_by_exception() || ...)) [[unlikely]] {
+        throw_bad_variant_access();
+    }
+    note_visit(vs...);
+    if constexpr (sizeof...(Vs) == 1 &&
+                  ((variant_size<std::decay_t<Vs>>::value <=
+                    SWITCH_DISPATCH_LIMIT) &&
+                   ...)) {
+        return dispatch_index<variant_size<std::decay_t<Vs>...>::value>(
+            vs.index()..., [&](auto index) -> decltype(auto) {
+                return std::invoke(
+                    std::forward<F>(f),
+                    VariantAccess::get<index>(std::forward<Vs>(vs))...);
+            });
+    } else {
+        using matrix = fmatrix<F&&, Vs&&...>;
+        return matrix::table[matrix::index(vs...)](std::forward<F>(f),
+                                                   std::forward<Vs>(vs)...);
+    }
 }
+}  // namespace variant_util
 
-template <typename F, typename... Vs, size_t... Is, size_t... Js,
-          typename... Ls>
-constexpr auto make_fmatrix_impl(std::index_sequence<Is...> /*unused*/,
-                                 std::index_sequence<Js...> /*unused*/,
-                                 Ls... ls) {
-    return make_array(make_fmatrix_impl<F, Vs...>(
-        std::index_sequence<Is..., Js>{}, ls...)...);
+// Alternative that Visit of a single V tests for first, as VisitLikely
+// does. Specialize it for variants where one alternative holds most of the
+// values; NPOS, the default, tests for none.
+template <typename V>
+struct variant_likely_alternative : std::integral_constant<size_t, NPOS> {};
+
+// Visit of a variant expected to hold the alternative Index: that one is
+// tested for first and gets a direct, inlinable call, and only the others
+// go through the dispatch switch or table.
+template <size_t Index, typename F, typename V>
+constexpr decltype(auto) VisitLikely(F&& f, V&& v) {
+    static_assert(Index < variant_size<std::decay_t<V>>::value,
+                  "Invalid index or type!");
+    if (v.index() == Index) [[likely]] {
+        variant_util::note_visit(v);
+        return std::invoke(std::forward<F>(f),
+                           VariantAccess::get<Index>(std::forward<V>(v)));
+    }
+    return variant_util::dispatch_visit(std::forward<F>(f),
+                                        std::forward<V>(v));
 }
 
 template <typename F, typename... Vs>
-constexpr auto make_fmatrix() {
-    return make_fmatrix_impl<F, Vs...>(
-        std::index_sequence<>{},
-        std::make_index_sequence<variant_size<std::decay_t<Vs>>::value>{}...);
+constexpr decltype(auto) Visit(F&& f, Vs&&... vs) {
+    if constexpr (sizeof...(Vs) == 1 &&
+                  ((variant_likely_alternative<std::decay_t<Vs>>::value !=
+                    NPOS) &&
+                   ...)) {
+        return VisitLikely<
+            variant_likely_alternative<std::decay_t<Vs>...>::value>(
+            std::forward<F>(f), std::forward<Vs>(vs)...);
+    } else {
+        return variant_util::dispatch_visit(std::forward<F>(f),
+                                            std::forward<Vs>(vs)...);
+    }
 }
 
-template <typename T>
-constexpr T&& at_impl(T&& elem) {
-    return std::forward<T>(elem);
+// Visit for visitors that only accept some combinations of alternatives.
+// Only the accepted combinations are instantiated; visiting any other one
+// throws.
+template <typename F, typename... Vs>
+constexpr decltype(auto) VisitPartial(F&& f, Vs&&... vs) {
+    if ((vs.valueless_by_exception() || ...)) [[unlikely]] {
+        variant_util::throw_bad_variant_access();
+    }
+    variant_util::note_visit(vs...);
+    using matrix = partial_fmatrix<F&&, Vs&&...>;
+    return matrix::table[matrix::index(vs...)](std::forward<F>(f),
+                                               std::forward<Vs>(vs)...);
 }
 
-template <typename T, typename... Is>
-constexpr auto&& at_impl(T&& elems, size_t i, Is... is) {
-    return at_impl(std::forward<T>(elems)[i], is...);
+namespace variant_util {
+template <typename Counters>
+uint64_t counter_total(size_t counter) {
+#if VARIANT_INSTRUMENTATION
+    return counter_registry<Counters>::instance().totals()[counter];
+#else
+    (void)counter;
+    return 0;
+#endif
 }
+}  // namespace variant_util
 
-template <typename T, typename... Is>
-constexpr auto&& at(T&& elems, Is... is) {
-    return at_impl(std::forward<T>(elems), is...);
+// Instrumentation counters of the variant type V, summed over all threads,
+// finished ones included. Alternatives are given by index(), NPOS for
+// valueless. All zero unless VARIANT_INSTRUMENTATION is set.
+//
+// How many times a V holding from was made to hold to by an assignment or
+// emplace that replaced its alternative.
+template <typename V>
+uint64_t VariantTransitionCount(size_t from, size_t to) {
+    using counters = variant_util::variant_counters<V>;
+    return variant_util::counter_total<counters>(
+        counters::transition(from + 1, to + 1));
 }
 
-template <typename F, typename... Vs>
-decltype(auto) Visit(F&& f, Vs&&... vs) {
-    static constexpr auto fmatrix = make_fmatrix<F&&, Vs&&...>();
-    return at(fmatrix, vs.index()...)(std::forward<F>(f),
-                                      std::forward<Vs>(vs)...);
+template <typename V>
+uint64_t VariantGetFailureCount(size_t index) {
+    using counters = variant_util::variant_counters<V>;
+    return variant_util::counter_total<counters>(counters::get_failure(index));
 }
+
+// How many times constructing an alternative of a V threw, leaving it
+// valueless.
+template <typename V>
+uint64_t VariantValuelessCount() {
+    using counters = variant_util::variant_counters<V>;
+    return variant_util::counter_total<counters>(counters::VALUELESS_EVENTS);
+}
+
+// How many times Visit or VisitPartial over variants of types Vs dispatched
+// to the given alternatives.
+template <typename... Vs>
+uint64_t VisitDispatchCount(std::array<size_t, sizeof...(Vs)> indices) {
+    using counters = variant_util::visit_counters<Vs...>;
+    size_t flat = 0;
+    size_t pos = 0;
+    ((flat = flat * variant_util::variant_counters<Vs>::COUNT + indices[pos++]),
+     ...);
+    return variant_util::counter_total<counters>(flat);
+}
+
+// Prints every non-zero instrumentation counter, grouped by variant type
+// and by the variant types visited together, with alternatives by type name.
+inline void DumpVariantStats(std::ostream& out = std::cerr) {
+#if VARIANT_INSTRUMENTATION
+    auto& directory = variant_util::stats_directory::instance();
+    std::vector<void (*)(std::ostream&)> dumps;
+    {
+        std::lock_guard lock(directory.mutex);
+        dumps = directory.dumps;
+    }
+    for (auto dump : dumps) {
+        dump(out);
+    }
+#else
+    out << "Variant instrumentation is disabled, see VARIANT_INSTRUMENTATION."
+        << std::endl;
+#endif
+}
+
+namespace variant_util {
+constexpr uint64_t HASH_INDEX_SALT = 0x9e3779b97f4a7c15;
+
+// Finalizer of MurmurHash3: every bit of key affects every bit of the result.
+constexpr uint64_t mix_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccd;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53;
+    key ^= key >> 33;
+    return key;
+}
+
+// Alternatives hashed by their own bit pattern rather than by std::hash, so
+// that a batch of variants of them is hashed without a dispatch per element.
+template <typename T>
+concept bit_hashable =
+    std::is_arithmetic_v<T> && sizeof(T) <= sizeof(uint64_t);
+
+template <typename T>
+concept hashable = bit_hashable<T> || requires(const T& value) {
+    { std::hash<T>{}(value) } -> std::convertible_to<size_t>;
+};
+
+template <size_t Size>
+using unsigned_of_size_t = std::conditional_t<
+    Size == 1, uint8_t,
+    std::conditional_t<Size == 2, uint16_t,
+                       std::conditional_t<Size == 4, uint32_t, uint64_t>>>;
+
+// The zero-extended bit pattern of bit_hashable values, with -0.0 folded
+// into 0.0 as the two compare equal; std::hash of anything else.
+template <typename T>
+uint64_t hash_key(const T& value) {
+    if constexpr (bit_hashable<T>) {
+        if constexpr (std::is_floating_point_v<T>) {
+            if (value == 0) {
+                return 0;
+            }
+        }
+        return std::bit_cast<unsigned_of_size_t<sizeof(T)>>(value);
+    } else {
+        return std::hash<T>{}(value);
+    }
+}
+
+constexpr size_t hash_variant(size_t index, uint64_t key) {
+    return mix_hash(key ^ (index * HASH_INDEX_SALT));
+}
+}  // namespace variant_util
+
+// Combines index() with the key of the active alternative. Valueless
+// variants all hash alike.
+template <typename... Types>
+    requires(variant_util::hashable<
+                 std::remove_const_t<unbox_t<Types>>> &&
+             ...)
+struct std::hash<Variant<Types...>> {
+    size_t operator()(const Variant<Types...>& v) const {
+        if (v.valueless_by_exception()) {
+            return variant_util::hash_variant(variant_util::NPOS, 0);
+        }
+        return variant_util::dispatch_index<sizeof...(Types)>(
+            v.index(), [&v](auto index) {
+                return variant_util::hash_variant(
+                    index, variant_util::hash_key(UncheckedGet<index>(v)));
+            });
+    }
+};
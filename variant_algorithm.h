@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+
+#include "variant.h"
+#include "variant_vector.h"
+
+namespace variant_util {
+template <typename Range>
+using range_variant_t =
+    std::remove_reference_t<std::ranges::range_reference_t<Range>>;
+
+// Calls f(std::integral_constant<size_t, I>{}) for every alternative I of a
+// variant with Count alternatives, in order.
+template <size_t Count, typename F>
+void for_each_index(F&& f) {
+    [&]<size_t... Is>(std::index_sequence<Is...> /*unused*/) {
+        (f(std::integral_constant<size_t, Is>{}), ...);
+    }(std::make_index_sequence<Count>{});
+}
+}  // namespace variant_util
+
+// Calls f on the active alternative of every variant of range, grouped by
+// alternative: the elements holding alternative 0 first, then those holding
+// alternative 1, and so on, each group in the order of range. The elements
+// are bucketed by index() with a counting sort, so there is one dispatch per
+// alternative rather than one per element, and f is inlined into a tight
+// loop over each group. Throws before calling f when an element is
+// valueless.
+template <typename F, std::ranges::random_access_range Range>
+    requires std::ranges::sized_range<Range>
+void VisitAll(F&& f, Range&& range) {
+    using V = variant_util::range_variant_t<Range>;
+    constexpr size_t COUNT = variant_size<std::remove_cv_t<V>>::value;
+    // The range is split into LANES consecutive slices that are counted and
+    // scattered side by side, each with its own counters. With a single set
+    // of counters, a run of equal indices increments the same counter over
+    // and over, and every increment waits for the previous one.
+    constexpr size_t LANES = 4;
+
+    auto first = std::ranges::begin(range);
+    const size_t size = std::ranges::size(range);
+    const size_t slice = size / LANES;
+    auto lane_begin = [&](size_t lane) {
+        return first + static_cast<std::ptrdiff_t>(lane * slice);
+    };
+    // The last lane also takes the remainder.
+    auto for_each_element = [&](auto&& body) {
+        for (size_t i = 0; i < slice; ++i) {
+            for (size_t lane = 0; lane < LANES; ++lane) {
+                body(lane, lane_begin(lane)[i]);
+            }
+        }
+        for (auto it = first + LANES * slice; it != first + size; ++it) {
+            body(LANES - 1, *it);
+        }
+    };
+
+    std::array<std::array<size_t, COUNT>, LANES> cursors{};
+    for_each_element([&](size_t lane, const auto& v) {
+        size_t index = v.index();
+        if (index >= COUNT) [[unlikely]] {
+            variant_util::throw_bad_variant_access();
+        }
+        ++cursors[lane][index];
+    });
+
+    // Group i starts at starts[i]; within it, the elements of lane l come
+    // after those of the lanes before it, which keeps the groups stable.
+    std::array<size_t, COUNT + 1> starts{};
+    for (size_t i = 0; i < COUNT; ++i) {
+        size_t position = starts[i];
+        for (size_t lane = 0; lane < LANES; ++lane) {
+            size_t count = cursors[lane][i];
+            cursors[lane][i] = position;
+            position += count;
+        }
+        starts[i + 1] = position;
+    }
+
+    auto grouped = std::make_unique_for_overwrite<V*[]>(size);
+    for_each_element([&](size_t lane, auto& v) {
+        grouped[cursors[lane][v.index()]++] = std::addressof(v);
+    });
+
+    variant_util::for_each_index<COUNT>([&](auto index) {
+        for (size_t i = starts[index]; i < starts[index + 1]; ++i) {
+            f(UncheckedGet<index>(*grouped[i]));
+        }
+    });
+}
+
+// A VariantVector is already grouped: each pool is walked as an array.
+template <typename F, typename... Types>
+void VisitAll(F&& f, VariantVector<Types...>& vector) {
+    variant_util::for_each_index<sizeof...(Types)>([&](auto index) {
+        for (auto& value : vector.template alternative<index>()) {
+            f(value);
+        }
+    });
+}
+
+template <typename F, typename... Types>
+void VisitAll(F&& f, const VariantVector<Types...>& vector) {
+    variant_util::for_each_index<sizeof...(Types)>([&](auto index) {
+        for (const auto& value : vector.template alternative<index>()) {
+            f(value);
+        }
+    });
+}
+
+// Calls f on the active alternative of every variant of range, in the order
+// of range. Consecutive elements holding the same alternative share one
+// dispatch and are visited by a tight loop, which pays off when the
+// alternatives come in runs.
+template <typename F, std::ranges::forward_range Range>
+void VisitEach(F&& f, Range&& range) {
+    using V = variant_util::range_variant_t<Range>;
+    constexpr size_t COUNT = variant_size<std::remove_cv_t<V>>::value;
+
+    auto it = std::ranges::begin(range);
+    auto end = std::ranges::end(range);
+    while (it != end) {
+        if ((*it).valueless_by_exception()) {
+            variant_util::throw_bad_variant_access();
+        }
+        it = variant_util::dispatch_index<COUNT>(
+            (*it).index(), [&](auto index) {
+                auto run = it;
+                do {
+                    f(UncheckedGet<index>(*run));
+                    ++run;
+                } while (run != end && (*run).index() == index);
+                return run;
+            });
+    }
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#include "variant.h"
+
+// Variant of trivially copyable alternatives shared between threads, such
+// as a configuration value that many readers poll and a writer swaps now
+// and then. The variant is held encoded: the bytes of its alternative,
+// zero-filled to the size of the largest one, followed by its index. When
+// that fits a lock-free atomic integer, every operation is a single atomic
+// one. Larger variants are kept behind a seqlock: a reader takes no lock,
+// and only copies the value again when a write was in progress meanwhile.
+// The index counts towards the size: Variant<int64_t, double, bool> encodes
+// to 9 bytes, so it takes the seqlock rather than a lock-free word.
+//
+// A valueless variant has no encoding, so only variants that are never
+// valueless can be held.
+
+namespace variant_util {
+inline void spin_pause() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// The encoded form of Variant<Types...>, in whole Word units.
+template <typename Word, typename... Types>
+struct atomic_encoding {
+    using variant_t = Variant<Types...>;
+    using index_t = index_type_t<sizeof...(Types)>;
+
+    static constexpr size_t STORAGE_BYTES = std::max({sizeof(Types)...});
+    static constexpr size_t BYTES = STORAGE_BYTES + sizeof(index_t);
+    static constexpr size_t WORDS = (BYTES + sizeof(Word) - 1) / sizeof(Word);
+
+    using words_t = std::array<Word, WORDS>;
+
+    static words_t encode(const variant_t& value) {
+        std::array<std::byte, WORDS * sizeof(Word)> bytes{};
+        dispatch_index<sizeof...(Types)>(value.index(), [&](auto index) {
+            std::memcpy(bytes.data(), &UncheckedGet<index>(value),
+                        sizeof(get_type_by_index_t<index, Types...>));
+        });
+        auto index = static_cast<index_t>(value.index());
+        std::memcpy(bytes.data() + STORAGE_BYTES, &index, sizeof(index));
+        words_t words;
+        std::memcpy(words.data(), bytes.data(), bytes.size());
+        return words;
+    }
+
+    static variant_t decode(const words_t& words) {
+        std::array<std::byte, WORDS * sizeof(Word)> bytes;
+        std::memcpy(bytes.data(), words.data(), bytes.size());
+        index_t stored;
+        std::memcpy(&stored, bytes.data() + STORAGE_BYTES, sizeof(stored));
+        return dispatch_index<sizeof...(Types)>(
+            stored, [&](auto index) -> variant_t {
+                using T = get_type_by_index_t<index, Types...>;
+                std::array<std::byte, sizeof(T)> alternative;
+                std::memcpy(alternative.data(), bytes.data(), sizeof(T));
+                return variant_t(
+                    std::in_place_index<index>,
+                    std::bit_cast<std::remove_const_t<T>>(alternative));
+            });
+    }
+};
+
+// Smallest unsigned integer the encoding fits in, or void when none does.
+template <size_t Bytes>
+using atomic_word_t = std::conditional_t<
+    Bytes <= 1, uint8_t,
+    std::conditional_t<
+        Bytes <= 2, uint16_t,
+        std::conditional_t<Bytes <= 4, uint32_t,
+                           std::conditional_t<Bytes <= 8, uint64_t, void>>>>;
+
+template <typename Word>
+constexpr bool lock_free_word_v = false;
+
+template <typename Word>
+    requires(!std::is_void_v<Word>)
+constexpr bool lock_free_word_v<Word> = std::atomic<Word>::is_always_lock_free;
+
+// The encoding in a single atomic integer.
+template <typename Word, typename... Types>
+class atomic_word_cell {
+  public:
+    using encoding = atomic_encoding<Word, Types...>;
+    using variant_t = Variant<Types...>;
+
+    explicit atomic_word_cell(const variant_t& value)
+        : word_(encoding::encode(value)[0]) {}
+
+    variant_t load() const {
+        return encoding::decode({word_.load()});
+    }
+
+    void store(const variant_t& value) {
+        word_.store(encoding::encode(value)[0]);
+    }
+
+    variant_t exchange(const variant_t& value) {
+        return encoding::decode({word_.exchange(encoding::encode(value)[0])});
+    }
+
+    bool compare_exchange(variant_t& expected, const variant_t& desired,
+                          bool weak) {
+        Word current = encoding::encode(expected)[0];
+        Word next = encoding::encode(desired)[0];
+        bool exchanged = weak ? word_.compare_exchange_weak(current, next)
+                              : word_.compare_exchange_strong(current, next);
+        if (!exchanged) {
+            expected = encoding::decode({current});
+        }
+        return exchanged;
+    }
+
+  private:
+    std::atomic<Word> word_;
+};
+
+// The encoding in relaxed atomic words, guarded by a sequence number that
+// is odd while a write is in progress. Writers take turns by making it odd
+// with a compare-exchange. Readers copy the words between two reads of the
+// sequence, and start over when it was odd or has changed.
+template <typename... Types>
+class seqlock_cell {
+  public:
+    using encoding = atomic_encoding<uint64_t, Types...>;
+    using variant_t = Variant<Types...>;
+    using words_t = typename encoding::words_t;
+
+    explicit seqlock_cell(const variant_t& value) {
+        write(encoding::encode(value));
+    }
+
+    variant_t load() const {
+        return encoding::decode(read());
+    }
+
+    void store(const variant_t& value) {
+        words_t words = encoding::encode(value);
+        uint32_t sequence = lock();
+        write(words);
+        unlock(sequence);
+    }
+
+    variant_t exchange(const variant_t& value) {
+        words_t words = encoding::encode(value);
+        uint32_t sequence = lock();
+        words_t previous = copy_words();
+        write(words);
+        unlock(sequence);
+        return encoding::decode(previous);
+    }
+
+    // Never fails spuriously.
+    bool compare_exchange(variant_t& expected, const variant_t& desired,
+                          bool /*weak*/) {
+        words_t expected_words = encoding::encode(expected);
+        words_t desired_words = encoding::encode(desired);
+        uint32_t sequence = lock();
+        words_t current = copy_words();
+        bool exchanged = current == expected_words;
+        if (exchanged) {
+            write(desired_words);
+        }
+        unlock(sequence);
+        if (!exchanged) {
+            expected = encoding::decode(current);
+        }
+        return exchanged;
+    }
+
+  private:
+    words_t read() const {
+        while (true) {
+            uint32_t before = sequence_.load(std::memory_order_acquire);
+            if (before % 2 == 0) {
+                words_t words = copy_words();
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sequence_.load(std::memory_order_relaxed) == before) {
+                    return words;
+                }
+            }
+            spin_pause();
+        }
+    }
+
+    words_t copy_words() const {
+        words_t words;
+        for (size_t i = 0; i < words.size(); ++i) {
+            words[i] = words_[i].load(std::memory_order_relaxed);
+        }
+        return words;
+    }
+
+    void write(const words_t& words) {
+        for (size_t i = 0; i < words.size(); ++i) {
+            words_[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+
+    // Returns the sequence number the write started from.
+    uint32_t lock() {
+        uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+        while (sequence % 2 != 0 ||
+               !sequence_.compare_exchange_weak(sequence, sequence + 1,
+                                                std::memory_order_acquire,
+                                                std::memory_order_relaxed)) {
+            spin_pause();
+            sequence = sequence_.load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        return sequence;
+    }
+
+    void unlock(uint32_t sequence) {
+        sequence_.store(sequence + 2, std::memory_order_release);
+    }
+
+    std::atomic<uint32_t> sequence_ = 0;
+    std::array<std::atomic<uint64_t>, encoding::WORDS> words_;
+};
+
+template <typename... Types>
+using atomic_word_for_t =
+    atomic_word_t<atomic_encoding<uint8_t, Types...>::BYTES>;
+
+template <typename... Types>
+using atomic_cell_t =
+    std::conditional_t<lock_free_word_v<atomic_word_for_t<Types...>>,
+                       atomic_word_cell<atomic_word_for_t<Types...>, Types...>,
+                       seqlock_cell<Types...>>;
+}  // namespace variant_util
+
+// Atomic Variant<Types...> for trivially copyable alternatives. Lock free
+// when the alternative bytes and the index fit an atomic integer, otherwise
+// behind a seqlock; see is_always_lock_free. Values are compared bitwise by
+// compare_exchange, as by std::atomic: 0.0 and -0.0 differ, and padding
+// inside an alternative can make a comparison fail.
+template <typename... Types>
+class AtomicVariant {
+  public:
+    using value_type = Variant<Types...>;
+
+    static_assert((std::is_trivially_copyable_v<Types> && ...),
+                  "AtomicVariant needs trivially copyable alternatives!");
+    static_assert(variant_never_valueless<value_type>::value,
+                  "AtomicVariant needs a never valueless variant!");
+
+    static constexpr bool is_always_lock_free = variant_util::lock_free_word_v<
+        variant_util::atomic_word_for_t<Types...>>;
+
+    AtomicVariant() : AtomicVariant(value_type()) {}
+
+    AtomicVariant(const value_type& value) : cell_(value) {}
+
+    AtomicVariant(const AtomicVariant&) = delete;
+    AtomicVariant& operator=(const AtomicVariant&) = delete;
+
+    value_type load() const {
+        return cell_.load();
+    }
+
+    void store(const value_type& value) {
+        cell_.store(value);
+    }
+
+    value_type exchange(const value_type& value) {
+        return cell_.exchange(value);
+    }
+
+    // On failure, expected becomes the current value.
+    bool compare_exchange_weak(value_type& expected,
+                               const value_type& desired) {
+        return cell_.compare_exchange(expected, desired, true);
+    }
+
+    bool compare_exchange_strong(value_type& expected,
+                                 const value_type& desired) {
+        return cell_.compare_exchange(expected, desired, false);
+    }
+
+  private:
+    variant_util::atomic_cell_t<Types...> cell_;
+};
@@ -0,0 +1,1518 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "variant.h"
+#include "variant_algorithm.h"
+#include "variant_atomic.h"
+#include "variant_hash.h"
+#include "variant_memory.h"
+#include "variant_tags.h"
+#include "variant_vector.h"
+
+// NOLINTBEGIN
+
+namespace bench {
+
+template <typename T>
+void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline void ClobberMemory() {
+    asm volatile("" : : : "memory");
+}
+
+// Runs `body` `repeats` times and returns the best observed time per
+// operation, where one call of `body` performs `ops` operations.
+template <typename F>
+double BestNsPerOp(size_t ops, F&& body, int repeats = 7) {
+    double best = 1e300;
+    for (int r = 0; r < repeats; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto finish = std::chrono::steady_clock::now();
+        double ns =
+            std::chrono::duration<double, std::nano>(finish - start).count();
+        best = std::min(best, ns / static_cast<double>(ops));
+    }
+    return best;
+}
+
+inline void Report(const std::string& name, double ns_per_op) {
+    std::cout << name;
+    for (size_t i = name.size(); i < 48; ++i) {
+        std::cout << ' ';
+    }
+    std::cout << ns_per_op << " ns/op" << std::endl;
+}
+
+// Time stamp counter ticks per nanosecond, measured against steady_clock.
+// Zero where there is no time stamp counter.
+inline double TicksPerNs() {
+#ifdef VARIANT_TAGS_X86
+    static const double ticks_per_ns = [] {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t start_ticks = __rdtsc();
+        while (std::chrono::steady_clock::now() - start <
+               std::chrono::milliseconds(20)) {
+        }
+        uint64_t ticks = __rdtsc() - start_ticks;
+        double ns = std::chrono::duration<double, std::nano>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        return static_cast<double>(ticks) / ns;
+    }();
+    return ticks_per_ns;
+#else
+    return 0;
+#endif
+}
+
+// Like Report, adding the throughput in elements per (reference) cycle.
+inline void ReportThroughput(const std::string& name, double ns_per_element) {
+    std::cout << name;
+    for (size_t i = name.size(); i < 48; ++i) {
+        std::cout << ' ';
+    }
+    std::cout << ns_per_element << " ns/op";
+    if (TicksPerNs() > 0) {
+        std::cout << ", " << 1 / (ns_per_element * TicksPerNs())
+                  << " elements/cycle";
+    }
+    std::cout << std::endl;
+}
+
+// Counts the instructions this thread retires between start() and stop(),
+// through perf_event_open. Unavailable where perf events are not permitted,
+// as in most containers.
+class InstructionCounter {
+  public:
+#ifdef __linux__
+    InstructionCounter() {
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(
+            syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~InstructionCounter() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+#else
+    InstructionCounter() = default;
+#endif
+
+    InstructionCounter(const InstructionCounter&) = delete;
+    InstructionCounter& operator=(const InstructionCounter&) = delete;
+
+    bool available() const {
+        return fd_ >= 0;
+    }
+
+    void start() {
+#ifdef __linux__
+        ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    uint64_t stop() {
+        uint64_t count = 0;
+#ifdef __linux__
+        ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+            count = 0;
+        }
+#endif
+        return count;
+    }
+
+  private:
+    int fd_ = -1;
+};
+
+struct Measurement {
+    double ns_per_op;
+    // Negative when instructions cannot be counted.
+    double instructions_per_op;
+};
+
+// Like BestNsPerOp, with setup() run untimed before every call of body, and
+// the instructions of one more call counted.
+template <typename Setup, typename F>
+Measurement Measure(size_t ops, Setup&& setup, F&& body, int repeats = 7) {
+    double best = 1e300;
+    for (int r = 0; r < repeats; ++r) {
+        setup();
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto finish = std::chrono::steady_clock::now();
+        double ns =
+            std::chrono::duration<double, std::nano>(finish - start).count();
+        best = std::min(best, ns / static_cast<double>(ops));
+    }
+    double instructions = -1;
+    static InstructionCounter counter;
+    if (counter.available()) {
+        setup();
+        counter.start();
+        body();
+        instructions = static_cast<double>(counter.stop()) /
+                       static_cast<double>(ops);
+    }
+    return {best, instructions};
+}
+
+// One line per operation: ours, then the reference.
+inline void ReportComparison(const std::string& name, Measurement ours,
+                             Measurement reference) {
+    auto print = [](Measurement m) {
+        std::cout << std::setw(9) << m.ns_per_op << " ns ";
+        if (m.instructions_per_op >= 0) {
+            std::cout << std::setw(7) << m.instructions_per_op << " ins";
+        } else {
+            std::cout << "    n/a ins";
+        }
+    };
+    std::cout << name;
+    for (size_t i = name.size(); i < 40; ++i) {
+        std::cout << ' ';
+    }
+    std::cout << std::setprecision(3);
+    print(ours);
+    std::cout << "  |";
+    print(reference);
+    std::cout << std::setprecision(6) << std::endl;
+}
+
+struct Suite {
+    const char* name;
+    void (*run)();
+};
+
+}  // namespace bench
+
+// Growth without reserve: every reallocation relocates the elements built
+// so far, which is a deep copy of each string unless the move is noexcept.
+void BenchVectorRelocation() {
+    using V = Variant<int, std::string>;
+    constexpr size_t N = 4096;
+    constexpr size_t ROUNDS = 16;
+    const std::string text(64, 'x');
+
+    bench::Report("vector<Variant<int, string>>::push_back (grow)",
+                  bench::BestNsPerOp(N * ROUNDS, [&] {
+                      for (size_t r = 0; r < ROUNDS; ++r) {
+                          std::vector<V> vec;
+                          for (size_t i = 0; i < N; ++i) {
+                              vec.push_back(V(text));
+                          }
+                          bench::DoNotOptimize(vec.data());
+                      }
+                  }));
+}
+
+void BenchVectorGrowth() {
+    using V = Variant<int, double>;
+    constexpr size_t N = 4096;
+    constexpr size_t ROUNDS = 256;
+
+    bench::Report("vector<Variant<int, double>>::push_back",
+                  bench::BestNsPerOp(N * ROUNDS, [] {
+                      std::vector<V> vec;
+                      vec.reserve(N);
+                      for (size_t r = 0; r < ROUNDS; ++r) {
+                          vec.clear();
+                          for (size_t i = 0; i < N; ++i) {
+                              vec.push_back(V(static_cast<int>(i)));
+                          }
+                          bench::DoNotOptimize(vec.data());
+                      }
+                  }));
+
+    // With libstdc++ 12, resize(n, value) and insert(pos, n, value) copy the
+    // value into a _Temporary_value first. Early SRA splits off the union's
+    // _M_byte and stores it back before every element copy, so any trivially
+    // copyable class with a user-provided default constructor (std::variant,
+    // or a struct holding one double) pays a store-forwarding stall per
+    // element here. assign(n, value) fills from the argument directly.
+    bench::Report("vector<Variant<int, double>>::resize",
+                  bench::BestNsPerOp(N * ROUNDS, [] {
+                      std::vector<V> vec;
+                      vec.reserve(N);
+                      for (size_t r = 0; r < ROUNDS; ++r) {
+                          vec.clear();
+                          vec.resize(N, V(1.5));
+                          bench::DoNotOptimize(vec.data());
+                      }
+                  }));
+
+    bench::Report("vector<Variant<int, double>>::assign",
+                  bench::BestNsPerOp(N * ROUNDS, [] {
+                      std::vector<V> vec;
+                      vec.reserve(N);
+                      const V value(1.5);
+                      for (size_t r = 0; r < ROUNDS; ++r) {
+                          vec.assign(N, value);
+                          bench::DoNotOptimize(vec.data());
+                      }
+                  }));
+
+    bench::Report("vector<Variant<int, double>>::reallocate",
+                  bench::BestNsPerOp(N * ROUNDS, [] {
+                      const std::vector<V> source(N, V(2));
+                      for (size_t r = 0; r < ROUNDS; ++r) {
+                          std::vector<V> vec = source;
+                          vec.reserve(2 * N);
+                          bench::DoNotOptimize(vec.data());
+                      }
+                  }));
+
+    BenchVectorRelocation();
+}
+
+template <size_t I>
+struct Alt {
+    static constexpr int ID = static_cast<int>(I) + 1;
+    int value;
+};
+
+template <size_t... Is>
+auto MakeAltVariant(std::index_sequence<Is...>) -> Variant<Alt<Is>...>;
+
+// Variant<Alt<0>, ..., Alt<N - 1>>
+template <size_t N>
+using AltVariant = decltype(MakeAltVariant(std::make_index_sequence<N>{}));
+
+template <typename V, size_t... Is>
+V MakeAlternative(size_t index, int value, std::index_sequence<Is...>) {
+    V result;
+    ((index == Is ? (result = V(Alt<Is>{value}), 0) : 0), ...);
+    return result;
+}
+
+// Alternative indices: uniformly random, or always the same one.
+template <size_t N>
+std::vector<AltVariant<N>> MakeAltValues(size_t size, bool random) {
+    std::vector<AltVariant<N>> values;
+    uint32_t state = 12345;
+    for (size_t i = 0; i < size; ++i) {
+        state = state * 1664525 + 1013904223;
+        size_t index = random ? (state >> 8) % N : N / 2;
+        values.push_back(MakeAlternative<AltVariant<N>>(
+            index, static_cast<int>(i), std::make_index_sequence<N>{}));
+    }
+    return values;
+}
+
+template <size_t N>
+void BenchVisitAlternatives() {
+    constexpr size_t SIZE = 4096;
+    constexpr size_t ROUNDS = 256;
+
+    for (bool random : {false, true}) {
+        auto values = MakeAltValues<N>(SIZE, random);
+        std::string name = "Visit " + std::to_string(N) + " alternatives" +
+                           (random ? " (random)" : " (same)");
+        bench::Report(name, bench::BestNsPerOp(SIZE * ROUNDS, [&] {
+                          long sum = 0;
+                          for (size_t r = 0; r < ROUNDS; ++r) {
+                              for (const auto& v : values) {
+                                  sum += Visit(
+                                      [](const auto& alt) {
+                                          return alt.value * alt.ID;
+                                      },
+                                      v);
+                              }
+                          }
+                          bench::DoNotOptimize(sum);
+                      }));
+    }
+}
+
+void BenchVisit() {
+    BenchVisitAlternatives<2>();
+    BenchVisitAlternatives<4>();
+    BenchVisitAlternatives<8>();
+    BenchVisitAlternatives<32>();
+}
+
+// Alternative indices: uniformly random, or nine in ten on alternative 0
+// and the rest uniformly random.
+template <size_t N>
+std::vector<AltVariant<N>> MakeMixedAltValues(size_t size, bool skewed) {
+    std::vector<AltVariant<N>> values;
+    uint32_t state = 54321;
+    for (size_t i = 0; i < size; ++i) {
+        state = state * 1664525 + 1013904223;
+        size_t index = (state >> 8) % N;
+        if (skewed && (state >> 20) % 10 != 0) {
+            index = 0;
+        }
+        values.push_back(MakeAlternative<AltVariant<N>>(
+            index, static_cast<int>(i), std::make_index_sequence<N>{}));
+    }
+    return values;
+}
+
+template <size_t N>
+void BenchVisitAllAlternatives() {
+    constexpr size_t SIZE = 4096;
+    constexpr size_t ROUNDS = 256;
+
+    auto visitor = [](long& sum) {
+        return [&sum](const auto& alt) {
+            sum += alt.value * alt.ID;
+        };
+    };
+
+    for (bool skewed : {false, true}) {
+        auto values = MakeMixedAltValues<N>(SIZE, skewed);
+        std::string suffix = " " + std::to_string(N) + " alternatives" +
+                             (skewed ? " (skewed)" : " (uniform)");
+        bench::Report("Visit loop" + suffix,
+                      bench::BestNsPerOp(SIZE * ROUNDS, [&] {
+                          long sum = 0;
+                          for (size_t r = 0; r < ROUNDS; ++r) {
+                              for (const auto& v : values) {
+                                  Visit(visitor(sum), v);
+                              }
+                          }
+                          bench::DoNotOptimize(sum);
+                      }));
+        bench::Report("VisitAll" + suffix,
+                      bench::BestNsPerOp(SIZE * ROUNDS, [&] {
+                          long sum = 0;
+                          for (size_t r = 0; r < ROUNDS; ++r) {
+                              VisitAll(visitor(sum), values);
+                          }
+                          bench::DoNotOptimize(sum);
+                      }));
+        bench::Report("VisitEach" + suffix,
+                      bench::BestNsPerOp(SIZE * ROUNDS, [&] {
+                          long sum = 0;
+                          for (size_t r = 0; r < ROUNDS; ++r) {
+                              VisitEach(visitor(sum), values);
+                          }
+                          bench::DoNotOptimize(sum);
+                      }));
+    }
+}
+
+void BenchVisitAll() {
+    BenchVisitAllAlternatives<4>();
+    BenchVisitAllAlternatives<8>();
+    BenchVisitAllAlternatives<32>();
+}
+
+// Visits of values nine in ten of which hold alternative 0: Visit, and
+// VisitLikely with the right hint and with a wrong one.
+template <size_t N>
+void BenchVisitLikelyAlternatives() {
+    constexpr size_t SIZE = 4096;
+    constexpr size_t ROUNDS = 256;
+
+    auto values = MakeMixedAltValues<N>(SIZE, true);
+    auto visitor = [](const auto& alt) {
+        return alt.value * alt.ID;
+    };
+    auto run = [&](const std::string& name, auto&& visit) {
+        bench::Report(std::to_string(N) + " alternatives, " + name,
+                      bench::BestNsPerOp(SIZE * ROUNDS, [&] {
+                          long sum = 0;
+                          for (size_t r = 0; r < ROUNDS; ++r) {
+                              for (const auto& v : values) {
+                                  sum += visit(v);
+                              }
+                          }
+                          bench::DoNotOptimize(sum);
+                      }));
+    };
+    run("Visit", [&](const auto& v) {
+        return Visit(visitor, v);
+    });
+    run("VisitLikely<0>", [&](const auto& v) {
+        return VisitLikely<0>(visitor, v);
+    });
+    run("VisitLikely<1>", [&](const auto& v) {
+        return VisitLikely<1>(visitor, v);
+    });
+}
+
+void BenchVisitLikely() {
+    BenchVisitLikelyAlternatives<4>();
+    BenchVisitLikelyAlternatives<8>();
+    BenchVisitLikelyAlternatives<32>();
+    BenchVisitLikelyAlternatives<40>();
+}
+
+void BenchTagScans() {
+    using variant_util::TagKernel;
+    constexpr size_t SIZE = 1 << 20;
+    constexpr size_t ALTERNATIVES = 5;
+    constexpr size_t ROUNDS = 16;
+
+    std::vector<uint8_t> tags(SIZE);
+    uint32_t state = 99;
+    for (auto& tag : tags) {
+        state = state * 1664525 + 1013904223;
+        tag = static_cast<uint8_t>((state >> 8) % ALTERNATIVES);
+    }
+    std::vector<size_t> out(SIZE);
+
+    std::vector<std::pair<TagKernel, std::string>> kernels = {
+        {TagKernel::SCALAR, "scalar"}};
+    if (variant_util::active_tag_kernel() != TagKernel::SCALAR) {
+        kernels.emplace_back(TagKernel::SSE2, "sse2");
+    }
+    if (variant_util::active_tag_kernel() == TagKernel::AVX2) {
+        kernels.emplace_back(TagKernel::AVX2, "avx2");
+    }
+
+    for (const auto& [kernel, name] : kernels) {
+        bench::ReportThroughput(
+            "count tag (" + name + ")",
+            bench::BestNsPerOp(SIZE * ROUNDS, [&] {
+                size_t count = 0;
+                for (size_t r = 0; r < ROUNDS; ++r) {
+                    count += variant_util::count_tag(kernel, tags.data(),
+                                                     SIZE, 3);
+                }
+                bench::DoNotOptimize(count);
+            }));
+        bench::ReportThroughput(
+            "histogram of 5 (" + name + ")",
+            bench::BestNsPerOp(SIZE * ROUNDS, [&] {
+                std::array<size_t, ALTERNATIVES> counts{};
+                for (size_t r = 0; r < ROUNDS; ++r) {
+                    variant_util::tag_histogram(kernel, tags.data(), SIZE,
+                                                counts);
+                    bench::DoNotOptimize(counts);
+                }
+            }));
+        bench::ReportThroughput(
+            "select tag (" + name + ")",
+            bench::BestNsPerOp(SIZE * ROUNDS, [&] {
+                for (size_t r = 0; r < ROUNDS; ++r) {
+                    bench::DoNotOptimize(variant_util::select_tag(
+                        kernel, tags.data(), SIZE, 3, out.data()));
+                }
+            }));
+        bench::ReportThroughput(
+            "partition by tag (" + name + ")",
+            bench::BestNsPerOp(SIZE * ROUNDS, [&] {
+                for (size_t r = 0; r < ROUNDS; ++r) {
+                    variant_util::partition_by_tag(kernel, tags.data(), SIZE,
+                                                   ALTERNATIVES, out.data());
+                    bench::DoNotOptimize(out.data());
+                }
+            }));
+    }
+}
+
+// Not trivially destructible, so copying and destroying a variant of these
+// goes through the active alternative dispatch.
+template <size_t I>
+struct OwnedAlt {
+    int value;
+
+    ~OwnedAlt() {
+        bench::DoNotOptimize(value);
+    }
+};
+
+template <size_t... Is>
+auto MakeOwnedVariant(std::index_sequence<Is...>) -> Variant<OwnedAlt<Is>...>;
+
+template <size_t N>
+using OwnedVariant = decltype(MakeOwnedVariant(std::make_index_sequence<N>{}));
+
+template <size_t N>
+void BenchCopyAlternatives() {
+    constexpr size_t SIZE = 4096;
+    constexpr size_t ROUNDS = 64;
+
+    std::vector<OwnedVariant<N>> source(SIZE);
+    for (size_t i = 1; i < SIZE; i += 2) {
+        source[i].template emplace<N - 1>(OwnedAlt<N - 1>{static_cast<int>(i)});
+    }
+    bench::Report("Copy and destroy " + std::to_string(N) + " alternatives",
+                  bench::BestNsPerOp(SIZE * ROUNDS, [&] {
+                      for (size_t r = 0; r < ROUNDS; ++r) {
+                          std::vector<OwnedVariant<N>> copy = source;
+                          bench::DoNotOptimize(copy.data());
+                      }
+                  }));
+}
+
+// 4 KiB alternative with a user-provided copy, which makes the copy of the
+// whole variant non-trivial.
+struct Page {
+    std::array<char, 4096> bytes{};
+
+    Page() = default;
+
+    Page(const Page& other) : bytes(other.bytes) {}
+};
+
+// Copying an int out of Variant<int, Page> must cost as much as copying
+// the int, with nothing done to the rest of the storage first.
+void BenchCopyLargeAlternative() {
+    using V = Variant<int, Page>;
+    constexpr size_t SIZE = 1 << 16;
+
+    for (size_t index : {0, 1}) {
+        V source = 7;
+        if (index == 1) {
+            source.emplace<Page>();
+        }
+        bench::Report(std::string("Copy Variant<int, Page> holding ") +
+                          (index == 0 ? "int" : "Page"),
+                      bench::BestNsPerOp(SIZE, [&] {
+                          for (size_t i = 0; i < SIZE; ++i) {
+                              V copy = source;
+                              bench::DoNotOptimize(copy);
+                          }
+                      }));
+    }
+}
+
+void BenchCopy() {
+    BenchCopyAlternatives<4>();
+    BenchCopyAlternatives<16>();
+    BenchCopyAlternatives<32>();
+    BenchCopyLargeAlternative();
+}
+
+// Nine in ten elements are ints: summing them walks a vector of variants
+// element by element, or the int pool of a VariantVector as a plain array.
+void BenchVariantVector() {
+    using V = Variant<int, double, std::string>;
+    constexpr size_t SIZE = 1 << 16;
+    constexpr size_t ROUNDS = 64;
+
+    std::vector<V> array(SIZE);
+    VariantVector<int, double, std::string> soa;
+    for (size_t i = 0; i < SIZE; ++i) {
+        if (i % 10 == 9) {
+            array[i].emplace<double>(static_cast<double>(i));
+            soa.emplace_back<double>(static_cast<double>(i));
+        } else {
+            array[i].emplace<int>(static_cast<int>(i));
+            soa.emplace_back<int>(static_cast<int>(i));
+        }
+    }
+
+    bench::Report("vector<Variant> sum of ints",
+                  bench::BestNsPerOp(SIZE * ROUNDS, [&] {
+                      long sum = 0;
+                      for (size_t r = 0; r < ROUNDS; ++r) {
+                          for (const auto& v : array) {
+                              if (const int* x = GetIf<int>(&v)) {
+                                  sum += *x;
+                              }
+                          }
+                      }
+                      bench::DoNotOptimize(sum);
+                  }));
+
+    bench::Report("VariantVector sum of ints",
+                  bench::BestNsPerOp(SIZE * ROUNDS, [&] {
+                      long sum = 0;
+                      for (size_t r = 0; r < ROUNDS; ++r) {
+                          for (int x : soa.alternative<int>()) {
+                              sum += x;
+                          }
+                      }
+                      bench::DoNotOptimize(sum);
+                  }));
+
+    size_t soa_bytes = soa.size() * (sizeof(uint8_t) + sizeof(uint32_t)) +
+                       soa.alternative<int>().size_bytes() +
+                       soa.alternative<double>().size_bytes();
+    std::cout << "bytes per element: vector<Variant> " << sizeof(V)
+              << ", VariantVector "
+              << static_cast<double>(soa_bytes) / static_cast<double>(SIZE)
+              << std::endl;
+}
+
+// Equality of variants holding the same alternative with equal values.
+struct SameValue {
+    template <typename V>
+    bool operator()(const V& a, const V& b) const {
+        return a.index() == b.index() &&
+               Visit(
+                   [&b](const auto& value) {
+                       using T = std::decay_t<decltype(value)>;
+                       return value == Get<T>(b);
+                   },
+                   a);
+    }
+};
+
+// Linear probing over flat arrays, sized up front for the keys to insert.
+template <typename Key, typename Value, typename Hash, typename Equal>
+class OpenAddressingMap {
+  public:
+    explicit OpenAddressingMap(size_t capacity)
+        : mask_(std::bit_ceil(2 * capacity) - 1),
+          keys_(mask_ + 1),
+          values_(mask_ + 1),
+          used_(mask_ + 1) {}
+
+    bool insert(const Key& key, const Value& value) {
+        return insert(key, value, Hash{}(key));
+    }
+
+    bool insert(const Key& key, const Value& value, size_t hash) {
+        for (size_t slot = hash & mask_;; slot = (slot + 1) & mask_) {
+            if (!used_[slot]) {
+                used_[slot] = 1;
+                keys_[slot] = key;
+                values_[slot] = value;
+                ++size_;
+                return true;
+            }
+            if (Equal{}(keys_[slot], key)) {
+                return false;
+            }
+        }
+    }
+
+    // Brings in the first slot probed for a key with the given hash.
+    void prefetch(size_t hash) const {
+        size_t slot = hash & mask_;
+        __builtin_prefetch(&used_[slot]);
+        __builtin_prefetch(&keys_[slot]);
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+  private:
+    size_t mask_;
+    size_t size_ = 0;
+    std::vector<Key> keys_;
+    std::vector<Value> values_;
+    std::vector<uint8_t> used_;
+};
+
+void BenchHash() {
+    using V = Variant<int64_t, double>;
+    constexpr size_t SIZE = 10'000'000;
+    constexpr size_t HOT = 1 << 12;
+    constexpr size_t ROUNDS = 1024;
+
+    std::vector<V> keys(SIZE);
+    uint64_t state = 42;
+    for (size_t i = 0; i < SIZE; ++i) {
+        state = state * 6364136223846793005 + 1442695040888963407;
+        if (state >> 63) {
+            keys[i].emplace<double>(static_cast<double>(state >> 11) * 0x1p-53);
+        } else {
+            keys[i].emplace<int64_t>(static_cast<int64_t>(state >> 1));
+        }
+    }
+    std::vector<size_t> hashes(HOT);
+
+    // Hashing alone, over a cache resident prefix of the keys.
+    bench::ReportThroughput("std::hash<Variant<int64_t, double>> loop",
+                            bench::BestNsPerOp(HOT * ROUNDS, [&] {
+                                std::hash<V> hash;
+                                for (size_t r = 0; r < ROUNDS; ++r) {
+                                    for (size_t i = 0; i < HOT; ++i) {
+                                        hashes[i] = hash(keys[i]);
+                                    }
+                                    bench::DoNotOptimize(hashes.data());
+                                }
+                            }));
+    bench::ReportThroughput("HashVariants<int64_t, double>",
+                            bench::BestNsPerOp(HOT * ROUNDS, [&] {
+                                for (size_t r = 0; r < ROUNDS; ++r) {
+                                    HashVariants(
+                                        std::span(keys).first(HOT), hashes);
+                                    bench::DoNotOptimize(hashes.data());
+                                }
+                            }));
+
+    // With more alternatives than the compiler turns into conditional
+    // moves, std::hash mispredicts the dispatch on random indices.
+    using Wide = Variant<int8_t, int16_t, int32_t, int64_t, float, double>;
+    std::vector<Wide> wide(HOT);
+    for (size_t i = 0; i < HOT; ++i) {
+        state = state * 6364136223846793005 + 1442695040888963407;
+        variant_util::dispatch_index<6>((state >> 40) % 6, [&](auto index) {
+            using T = get_type_by_index_t<index, int8_t, int16_t, int32_t,
+                                          int64_t, float, double>;
+            wide[i].emplace<index>(static_cast<T>(state));
+        });
+    }
+    bench::ReportThroughput("std::hash<Variant<6 arithmetic>> loop",
+                            bench::BestNsPerOp(HOT * ROUNDS, [&] {
+                                std::hash<Wide> hash;
+                                for (size_t r = 0; r < ROUNDS; ++r) {
+                                    for (size_t i = 0; i < HOT; ++i) {
+                                        hashes[i] = hash(wide[i]);
+                                    }
+                                    bench::DoNotOptimize(hashes.data());
+                                }
+                            }));
+    bench::ReportThroughput("HashVariants<6 arithmetic>",
+                            bench::BestNsPerOp(HOT * ROUNDS, [&] {
+                                for (size_t r = 0; r < ROUNDS; ++r) {
+                                    HashVariants(wide, hashes);
+                                    bench::DoNotOptimize(hashes.data());
+                                }
+                            }));
+
+    bench::Report("unordered_map insert 10M",
+                  bench::BestNsPerOp(
+                      SIZE,
+                      [&] {
+                          std::unordered_map<V, uint32_t, std::hash<V>,
+                                             SameValue>
+                              map;
+                          map.reserve(SIZE);
+                          for (size_t i = 0; i < SIZE; ++i) {
+                              map.emplace(keys[i], static_cast<uint32_t>(i));
+                          }
+                          bench::DoNotOptimize(map.size());
+                      },
+                      3));
+
+    using Map = OpenAddressingMap<V, uint32_t, std::hash<V>, SameValue>;
+    bench::Report("open addressing insert 10M",
+                  bench::BestNsPerOp(
+                      SIZE,
+                      [&] {
+                          Map map(SIZE);
+                          for (size_t i = 0; i < SIZE; ++i) {
+                              map.insert(keys[i], static_cast<uint32_t>(i));
+                          }
+                          bench::DoNotOptimize(map.size());
+                      },
+                      3));
+    // Hashing a block ahead lets the slots of the next keys be prefetched
+    // while the current one is inserted.
+    constexpr size_t PREFETCH = 16;
+    bench::Report("open addressing insert 10M (HashVariants)",
+                  bench::BestNsPerOp(
+                      SIZE,
+                      [&] {
+                          Map map(SIZE);
+                          std::span<const V> all(keys);
+                          for (size_t begin = 0; begin < SIZE;
+                               begin += HOT) {
+                              auto block = all.subspan(
+                                  begin, std::min(HOT, SIZE - begin));
+                              HashVariants(block, hashes);
+                              for (size_t i = 0; i < block.size(); ++i) {
+                                  if (i + PREFETCH < block.size()) {
+                                      map.prefetch(hashes[i + PREFETCH]);
+                                  }
+                                  map.insert(block[i],
+                                             static_cast<uint32_t>(begin + i),
+                                             hashes[i]);
+                              }
+                          }
+                          bench::DoNotOptimize(map.size());
+                      },
+                      3));
+}
+
+// Sorting by operator<, which dispatches once on the shared alternative,
+// against std::variant and against the comparator one would write with a
+// Visit of both operands.
+void BenchSort() {
+    using V = Variant<int64_t, double>;
+    using StdV = std::variant<int64_t, double>;
+    constexpr size_t SIZE = 10'000'000;
+
+    std::vector<V> values(SIZE);
+    std::vector<StdV> std_values(SIZE);
+    uint64_t state = 7;
+    for (size_t i = 0; i < SIZE; ++i) {
+        state = state * 6364136223846793005 + 1442695040888963407;
+        if (state >> 63) {
+            values[i].emplace<double>(static_cast<double>(state >> 11));
+            std_values[i].emplace<double>(static_cast<double>(state >> 11));
+        } else {
+            values[i].emplace<int64_t>(static_cast<int64_t>(state >> 1));
+            std_values[i].emplace<int64_t>(static_cast<int64_t>(state >> 1));
+        }
+    }
+
+    // Each run sorts a fresh copy; the copy is a few percent of the time.
+    auto sort_copy = [](const auto& input, auto less) {
+        return [&input, less] {
+            auto copy = input;
+            std::sort(copy.begin(), copy.end(), less);
+            bench::DoNotOptimize(copy.data());
+        };
+    };
+    bench::Report("sort 10M Variant<int64_t, double>",
+                  bench::BestNsPerOp(SIZE, sort_copy(values, std::less<>()),
+                                     3));
+    bench::Report("sort 10M std::variant<int64_t, double>",
+                  bench::BestNsPerOp(
+                      SIZE, sort_copy(std_values, std::less<>()), 3));
+    auto visit_less = [](const V& a, const V& b) {
+        if (a.index() != b.index()) {
+            return a.index() < b.index();
+        }
+        return Visit(
+            [](const auto& x, const auto& y) {
+                if constexpr (std::is_same_v<decltype(x), decltype(y)>) {
+                    return x < y;
+                } else {
+                    return false;
+                }
+            },
+            a, b);
+    };
+    bench::Report("sort 10M Variant<int64_t, double> (Visit)",
+                  bench::BestNsPerOp(SIZE, sort_copy(values, visit_less), 3));
+}
+
+struct Payload {
+    std::array<char, 512> bytes{};
+};
+
+struct SmallValue {
+    long operator()(int x) const {
+        return x;
+    }
+
+    long operator()(double /*unused*/) const {
+        return 0;
+    }
+
+    long operator()(const Payload& payload) const {
+        return payload.bytes[0];
+    }
+};
+
+// A vector of mostly small values with a rare large one, with the large
+// alternative inline and boxed: inline, every element is as big as the
+// Payload.
+template <typename V>
+void BenchBoxedSum(const std::string& name) {
+    constexpr size_t SIZE = 1 << 20;
+    constexpr size_t ROUNDS = 8;
+
+    std::vector<V> values(SIZE);
+    for (size_t i = 0; i < SIZE; ++i) {
+        if (i % 100 == 99) {
+            values[i].template emplace<Payload>();
+        } else {
+            values[i].template emplace<int>(static_cast<int>(i));
+        }
+    }
+
+    bench::Report(name + " (" + std::to_string(sizeof(V)) + " bytes)",
+                  bench::BestNsPerOp(SIZE * ROUNDS, [&] {
+                      long sum = 0;
+                      for (size_t r = 0; r < ROUNDS; ++r) {
+                          for (const auto& v : values) {
+                              sum += Visit(SmallValue(), v);
+                          }
+                      }
+                      bench::DoNotOptimize(sum);
+                  }));
+}
+
+void BenchBoxed() {
+    BenchBoxedSum<Variant<int, double, Payload>>("sum, Payload inline");
+    BenchBoxedSum<Variant<int, double, Boxed<Payload>>>("sum, Payload boxed");
+}
+
+// A binary tree whose nodes are boxed with Allocator.
+template <typename Allocator>
+struct AllocTreeNode;
+
+template <typename Allocator>
+using AllocTree = Variant<int, Boxed<AllocTreeNode<Allocator>, Allocator>>;
+
+template <typename Allocator>
+struct AllocTreeNode {
+    AllocTree<Allocator> left;
+    AllocTree<Allocator> right;
+};
+
+template <typename Allocator>
+void BuildTree(AllocTree<Allocator>& tree, int depth, const Allocator& alloc,
+               int& leaf) {
+    if (depth == 0) {
+        tree.template emplace<0>(leaf++);
+        return;
+    }
+    auto& node = tree.template emplace<1>(std::allocator_arg, alloc);
+    BuildTree(node.left, depth - 1, alloc, leaf);
+    BuildTree(node.right, depth - 1, alloc, leaf);
+}
+
+// Builds and tears down a tree of about a million nodes allocated with
+// alloc, then calls release(), per round.
+template <typename Allocator, typename F>
+void BenchTreeBuild(const std::string& name, const Allocator& alloc,
+                    F&& release) {
+    constexpr int DEPTH = 19;
+    constexpr size_t NODES = (size_t{2} << DEPTH) - 1;
+
+    bench::Report(name, bench::BestNsPerOp(NODES, [&] {
+                      int leaf = 0;
+                      {
+                          AllocTree<Allocator> tree;
+                          BuildTree(tree, DEPTH, alloc, leaf);
+                          bench::DoNotOptimize(tree);
+                      }
+                      release();
+                      bench::DoNotOptimize(leaf);
+                  }));
+}
+
+void BenchAlloc() {
+    using Pmr = std::pmr::polymorphic_allocator<>;
+    auto nothing = [] {};
+    BenchTreeBuild("tree, std::allocator", std::allocator<void>(), nothing);
+    BenchTreeBuild("tree, new_delete_resource",
+                   Pmr(std::pmr::new_delete_resource()), nothing);
+    // Teardown runs every destructor, but frees the memory in one go.
+    ArenaResource arena;
+    BenchTreeBuild("tree, ArenaResource", Pmr(&arena), [&] {
+        arena.release();
+    });
+    std::pmr::monotonic_buffer_resource monotonic;
+    BenchTreeBuild("tree, monotonic_buffer_resource", Pmr(&monotonic), [&] {
+        monotonic.release();
+    });
+    // The pools keep their memory between rounds.
+    PoolResource pool;
+    BenchTreeBuild("tree, PoolResource", Pmr(&pool), nothing);
+    std::pmr::unsynchronized_pool_resource std_pool;
+    BenchTreeBuild("tree, unsynchronized_pool_resource", Pmr(&std_pool),
+                   nothing);
+}
+
+// A large value whose move is a full copy of its bytes, and counted.
+struct MoveHeavy {
+    static inline size_t moves = 0;
+
+    std::array<char, 256> bytes;
+
+    explicit MoveHeavy(char fill) {
+        bytes.fill(fill);
+    }
+
+    MoveHeavy(MoveHeavy&& other) noexcept : bytes(other.bytes) {
+        ++moves;
+    }
+};
+
+// Builds a variant per iteration with make(i), and reports the time and the
+// number of MoveHeavy moves each one costs.
+template <typename F>
+void BenchBuild(const std::string& name, F&& make) {
+    constexpr size_t SIZE = 1 << 16;
+    constexpr int REPEATS = 7;
+
+    MoveHeavy::moves = 0;
+    double ns = bench::BestNsPerOp(
+        SIZE,
+        [&] {
+            for (size_t i = 0; i < SIZE; ++i) {
+                auto v = make(static_cast<char>(i));
+                bench::DoNotOptimize(v);
+            }
+        },
+        REPEATS);
+    size_t moves = MoveHeavy::moves / (SIZE * REPEATS);
+    bench::Report(name + ", " + std::to_string(moves) + " moves", ns);
+}
+
+void BenchInPlace() {
+    using V = Variant<int, MoveHeavy>;
+    using StdV = std::variant<int, MoveHeavy>;
+    BenchBuild("Variant from value", [](char fill) {
+        return V(MoveHeavy(fill));
+    });
+    BenchBuild("Variant in place", [](char fill) {
+        return V(std::in_place_type<MoveHeavy>, fill);
+    });
+    BenchBuild("std::variant from value", [](char fill) {
+        return StdV(MoveHeavy(fill));
+    });
+    BenchBuild("std::variant in place", [](char fill) {
+        return StdV(std::in_place_type<MoveHeavy>, fill);
+    });
+}
+
+// Alternatives that are neither trivially copyable nor trivially
+// destructible.
+template <size_t I>
+struct StringAlt {
+    int value = 0;
+    std::string text = "alternative";
+
+    StringAlt() = default;
+
+    explicit StringAlt(int value) : value(value) {}
+};
+
+template <template <typename...> class V, template <size_t> class A,
+          size_t... Is>
+auto MakeFamily(std::index_sequence<Is...>) -> V<A<Is>...>;
+
+// V<A<0>, ..., A<N - 1>>, for V either Variant or std::variant.
+template <template <typename...> class V, template <size_t> class A,
+          size_t N>
+using Family = decltype(MakeFamily<V, A>(std::make_index_sequence<N>{}));
+
+template <size_t I, typename... Types>
+const auto& GetOf(const Variant<Types...>& v) {
+    return Get<I>(v);
+}
+
+template <size_t I, typename... Types>
+const auto& GetOf(const std::variant<Types...>& v) {
+    return std::get<I>(v);
+}
+
+template <typename F, typename... Types, typename... Rest>
+decltype(auto) VisitOf(F&& f, const Variant<Types...>& v,
+                       const Rest&... rest) {
+    return Visit(std::forward<F>(f), v, rest...);
+}
+
+template <typename F, typename... Types, typename... Rest>
+decltype(auto) VisitOf(F&& f, const std::variant<Types...>& v,
+                       const Rest&... rest) {
+    return std::visit(std::forward<F>(f), v, rest...);
+}
+
+// Variants holding uniformly random alternatives, different at every
+// position for different seeds.
+template <typename V, template <size_t> class A, size_t N>
+std::vector<V> MakeFamilyValues(size_t size, uint32_t seed) {
+    std::vector<V> values(size);
+    uint32_t state = seed;
+    for (size_t i = 0; i < size; ++i) {
+        state = state * 1664525 + 1013904223;
+        size_t index = (state >> 8) % N;
+        [&]<size_t... Is>(std::index_sequence<Is...> /*unused*/) {
+            ((index == Is
+                  ? (values[i].template emplace<Is>(
+                         A<Is>{static_cast<int>(i)}),
+                     0)
+                  : 0),
+             ...);
+        }(std::make_index_sequence<N>{});
+    }
+    return values;
+}
+
+// Uninitialized room for variants, for measuring construction and
+// destruction apart.
+template <typename V>
+class Slots {
+  public:
+    explicit Slots(size_t size)
+        : size_(size), memory_(std::make_unique<Storage[]>(size)) {}
+
+    Slots(const Slots&) = delete;
+    Slots& operator=(const Slots&) = delete;
+
+    ~Slots() {
+        clear();
+    }
+
+    V* operator[](size_t i) {
+        return std::launder(reinterpret_cast<V*>(&memory_[i]));
+    }
+
+    // All slots have been constructed.
+    void set_constructed() {
+        constructed_ = true;
+    }
+
+    void clear() {
+        if (constructed_) {
+            for (size_t i = 0; i < size_; ++i) {
+                std::destroy_at((*this)[i]);
+            }
+            constructed_ = false;
+        }
+    }
+
+  private:
+    struct alignas(V) Storage {
+        std::byte bytes[sizeof(V)];
+    };
+
+    size_t size_;
+    std::unique_ptr<Storage[]> memory_;
+    bool constructed_ = false;
+};
+
+constexpr const char* COMPARED_OPERATIONS[] = {
+    "construct",    "copy construct", "move construct",
+    "destroy",      "assign same",    "assign other",
+    "emplace",      "Get",            "Visit",
+    "Visit 2",
+};
+
+// Every operation of COMPARED_OPERATIONS, in order, per variant of V.
+// Alternatives are random unless the operation needs a given one.
+template <typename V, template <size_t> class A, size_t N>
+std::vector<bench::Measurement> MeasureOperations() {
+    constexpr size_t SIZE = 4096;
+    constexpr size_t LAST = N - 1;
+
+    const auto values = MakeFamilyValues<V, A, N>(SIZE, 2024);
+    const auto others = MakeFamilyValues<V, A, N>(SIZE, 4048);
+    std::vector<V> lasts(SIZE);
+    for (auto& v : lasts) {
+        v.template emplace<LAST>(A<LAST>{1});
+    }
+    std::vector<V> targets;
+    Slots<V> slots(SIZE);
+    long sum = 0;
+
+    auto nothing = [] {};
+    auto clear_slots = [&] {
+        slots.clear();
+    };
+    auto copy_to_slots = [&] {
+        slots.clear();
+        for (size_t i = 0; i < SIZE; ++i) {
+            std::construct_at(slots[i], values[i]);
+        }
+        slots.set_constructed();
+    };
+    auto copy_others = [&] {
+        targets = others;
+    };
+
+    std::vector<bench::Measurement> results;
+    results.push_back(bench::Measure(SIZE, clear_slots, [&] {
+        for (size_t i = 0; i < SIZE; ++i) {
+            std::construct_at(slots[i], A<LAST>{static_cast<int>(i)});
+        }
+        slots.set_constructed();
+    }));
+    results.push_back(bench::Measure(SIZE, clear_slots, [&] {
+        for (size_t i = 0; i < SIZE; ++i) {
+            std::construct_at(slots[i], values[i]);
+        }
+        slots.set_constructed();
+    }));
+    results.push_back(bench::Measure(
+        SIZE,
+        [&] {
+            slots.clear();
+            targets = values;
+        },
+        [&] {
+            for (size_t i = 0; i < SIZE; ++i) {
+                std::construct_at(slots[i], std::move(targets[i]));
+            }
+            slots.set_constructed();
+        }));
+    results.push_back(bench::Measure(SIZE, copy_to_slots, [&] {
+        slots.clear();
+    }));
+    results.push_back(bench::Measure(
+        SIZE,
+        [&] {
+            targets = values;
+        },
+        [&] {
+            for (size_t i = 0; i < SIZE; ++i) {
+                targets[i] = values[i];
+            }
+        }));
+    results.push_back(bench::Measure(SIZE, copy_others, [&] {
+        for (size_t i = 0; i < SIZE; ++i) {
+            targets[i] = values[i];
+        }
+    }));
+    results.push_back(bench::Measure(SIZE, copy_others, [&] {
+        for (size_t i = 0; i < SIZE; ++i) {
+            targets[i].template emplace<LAST>(A<LAST>{static_cast<int>(i)});
+        }
+    }));
+    results.push_back(bench::Measure(SIZE, nothing, [&] {
+        for (size_t i = 0; i < SIZE; ++i) {
+            sum += GetOf<LAST>(lasts[i]).value;
+        }
+        bench::DoNotOptimize(sum);
+    }));
+    results.push_back(bench::Measure(SIZE, nothing, [&] {
+        for (size_t i = 0; i < SIZE; ++i) {
+            sum += VisitOf(
+                [](const auto& alt) {
+                    return alt.value;
+                },
+                values[i]);
+        }
+        bench::DoNotOptimize(sum);
+    }));
+    // N^2 dispatchers per variant type: the compile time for more
+    // alternatives is measured by make bench_compile instead.
+    if constexpr (N <= 8) {
+        results.push_back(bench::Measure(SIZE, nothing, [&] {
+            for (size_t i = 0; i < SIZE; ++i) {
+                sum += VisitOf(
+                    [](const auto& a, const auto& b) {
+                        return a.value - b.value;
+                    },
+                    values[i], others[i]);
+            }
+            bench::DoNotOptimize(sum);
+        }));
+    }
+    return results;
+}
+
+template <template <size_t> class A, size_t N>
+void BenchCompareFamily(const std::string& kind) {
+    auto ours = MeasureOperations<Family<Variant, A, N>, A, N>();
+    auto reference = MeasureOperations<Family<std::variant, A, N>, A, N>();
+    for (size_t op = 0; op < ours.size(); ++op) {
+        bench::ReportComparison(std::string(COMPARED_OPERATIONS[op]) + ", " +
+                                    std::to_string(N) + " " + kind,
+                                ours[op], reference[op]);
+    }
+}
+
+// Variant against std::variant, per operation: time and instructions per
+// variant, Variant on the left.
+void BenchCompare() {
+    std::cout << std::string(40, ' ') << std::setw(24) << "Variant" << "  |"
+              << std::setw(24) << "std::variant" << std::endl;
+    BenchCompareFamily<Alt, 2>("trivial");
+    BenchCompareFamily<Alt, 8>("trivial");
+    BenchCompareFamily<Alt, 64>("trivial");
+    BenchCompareFamily<StringAlt, 2>("non-trivial");
+    BenchCompareFamily<StringAlt, 8>("non-trivial");
+    BenchCompareFamily<StringAlt, 64>("non-trivial");
+}
+
+// The alternatives of AltVariant and a string, in variants that opt out of
+// the never valueless policy.
+template <size_t I>
+struct OptedOutAlt : Alt<I> {};
+
+template <size_t... Is>
+struct variant_never_valueless<Variant<OptedOutAlt<Is>...>> : std::false_type {
+};
+
+struct OptedOutString : std::string {
+    using std::string::string;
+};
+
+template <>
+struct variant_never_valueless<Variant<int, OptedOutString>>
+    : std::false_type {};
+
+// Visits of pairs of variants with random indices, through the function
+// table: never valueless variants skip the valueless check and read the
+// index as is.
+template <template <size_t> class A, size_t N>
+void BenchPairVisit(const std::string& name) {
+    using V = Family<Variant, A, N>;
+    constexpr size_t SIZE = 4096;
+    constexpr size_t ROUNDS = 256;
+
+    std::vector<V> values(SIZE);
+    uint32_t state = 12345;
+    for (size_t i = 0; i < SIZE; ++i) {
+        state = state * 1664525 + 1013904223;
+        variant_util::dispatch_index<N>((state >> 8) % N, [&](auto index) {
+            values[i].template emplace<index>().value = static_cast<int>(i);
+        });
+    }
+    bench::Report(name, bench::BestNsPerOp(SIZE * ROUNDS, [&] {
+                      long sum = 0;
+                      for (size_t r = 0; r < ROUNDS; ++r) {
+                          for (size_t i = 0; i + 1 < SIZE; ++i) {
+                              sum += Visit(
+                                  [](const auto& a, const auto& b) {
+                                      return a.value * a.ID + b.value;
+                                  },
+                                  values[i], values[i + 1]);
+                          }
+                      }
+                      bench::DoNotOptimize(sum);
+                  }));
+}
+
+// Alternates between an int and a short string, whose constructor may
+// throw: a never valueless variant builds the string in a temporary first.
+template <typename V>
+void BenchStringReplace(const std::string& name) {
+    constexpr size_t SIZE = 1 << 16;
+
+    V v;
+    bench::Report(name, bench::BestNsPerOp(SIZE, [&] {
+                      for (size_t i = 0; i < SIZE; ++i) {
+                          if (i % 2 == 0) {
+                              v.template emplace<1>("short");
+                          } else {
+                              v.template emplace<0>(static_cast<int>(i));
+                          }
+                          bench::DoNotOptimize(v);
+                      }
+                  }));
+}
+
+void BenchValueless() {
+    BenchPairVisit<Alt, 4>("Visit pair, 4 alternatives, never valueless");
+    BenchPairVisit<OptedOutAlt, 4>("Visit pair, 4 alternatives, opted out");
+    BenchPairVisit<Alt, 8>("Visit pair, 8 alternatives, never valueless");
+    BenchPairVisit<OptedOutAlt, 8>("Visit pair, 8 alternatives, opted out");
+    BenchStringReplace<Variant<int, std::string>>(
+        "int/string emplace, never valueless");
+    BenchStringReplace<Variant<int, OptedOutString>>(
+        "int/string emplace, opted out");
+}
+
+// A variant behind a mutex, the way hot-swapped values are shared without
+// AtomicVariant.
+template <typename... Types>
+class MutexVariant {
+  public:
+    using value_type = Variant<Types...>;
+
+    explicit MutexVariant(const value_type& value) : value_(value) {}
+
+    value_type load() const {
+        std::lock_guard lock(mutex_);
+        return value_;
+    }
+
+    void store(const value_type& value) {
+        std::lock_guard lock(mutex_);
+        value_ = value;
+    }
+
+  private:
+    mutable std::mutex mutex_;
+    value_type value_;
+};
+
+// Reader threads load the value over and over, while a writer stores a new
+// one every 50 microseconds. Reports the time per load over all readers.
+template <typename Cell>
+void BenchReaders(const std::string& name) {
+    constexpr size_t LOADS = 1 << 16;
+
+    for (size_t readers : {1, 2, 4, 8, 16, 32, 64}) {
+        using V = typename Cell::value_type;
+        Cell cell(V(std::in_place_index<0>, 0));
+        std::atomic<bool> stop = false;
+        std::thread writer([&] {
+            for (int64_t n = 1; !stop.load(std::memory_order_relaxed); ++n) {
+                if (n % 2 == 0) {
+                    cell.store(V(std::in_place_index<1>, n));
+                } else {
+                    cell.store(V(std::in_place_index<0>, n));
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        });
+        double ns = bench::BestNsPerOp(
+            readers * LOADS,
+            [&] {
+                std::vector<std::thread> threads;
+                for (size_t r = 0; r < readers; ++r) {
+                    threads.emplace_back([&] {
+                        double sum = 0;
+                        for (size_t i = 0; i < LOADS; ++i) {
+                            sum += Visit(
+                                [](auto alt) {
+                                    return static_cast<double>(alt);
+                                },
+                                cell.load());
+                        }
+                        bench::DoNotOptimize(sum);
+                    });
+                }
+                for (auto& thread : threads) {
+                    thread.join();
+                }
+            },
+            3);
+        stop = true;
+        writer.join();
+        bench::Report(name + ", " + std::to_string(readers) + " readers", ns);
+    }
+}
+
+void BenchAtomic() {
+    std::cout << std::thread::hardware_concurrency() << " hardware threads"
+              << std::endl;
+    BenchReaders<AtomicVariant<int32_t, float, bool>>(
+        "AtomicVariant, lock free");
+    BenchReaders<AtomicVariant<int64_t, double, bool>>(
+        "AtomicVariant, seqlock");
+    BenchReaders<MutexVariant<int64_t, double, bool>>("Mutex and Variant");
+}
+
+int main(int argc, char** argv) {
+    const bench::Suite suites[] = {
+        {"vector", BenchVectorGrowth},
+        {"visit", BenchVisit},
+        {"visitall", BenchVisitAll},
+        {"likely", BenchVisitLikely},
+        {"copy", BenchCopy},
+        {"soa", BenchVariantVector},
+        {"tags", BenchTagScans},
+        {"hash", BenchHash},
+        {"sort", BenchSort},
+        {"boxed", BenchBoxed},
+        {"alloc", BenchAlloc},
+        {"inplace", BenchInPlace},
+        {"compare", BenchCompare},
+        {"valueless", BenchValueless},
+        {"atomic", BenchAtomic},
+    };
+
+    for (const auto& suite : suites) {
+        if (argc > 1 && std::strcmp(argv[1], suite.name) != 0) {
+            continue;
+        }
+        std::cout << "== " << suite.name << " ==" << std::endl;
+        suite.run();
+    }
+}
+
+// NOLINTEND
@@ -0,0 +1,45 @@
+// Translation unit for compile-time measurements: touches every alternative
+// of a variant with ALTERNATIVES alternatives through Get, emplace,
+// holds_alternative and the converting assignment. Built, not run, by the
+// compile-time targets of the Makefile.
+
+#include <utility>
+
+#include "variant.h"
+
+// NOLINTBEGIN
+
+#ifndef ALTERNATIVES
+#define ALTERNATIVES 128
+#endif
+
+template <size_t I>
+struct Alt {
+    int value;
+};
+
+template <size_t... Is>
+auto MakeAltVariant(std::index_sequence<Is...>) -> Variant<Alt<Is>...>;
+
+using V = decltype(MakeAltVariant(std::make_index_sequence<ALTERNATIVES>{}));
+
+template <size_t I>
+int Touch(V& v) {
+    v.emplace<I>(Alt<I>{static_cast<int>(I)});
+    int sum = Get<I>(v).value;
+    v = Alt<I>{sum + 1};
+    sum += Get<Alt<I>>(v).value;
+    return holds_alternative<Alt<I>>(v) ? sum : 0;
+}
+
+template <size_t... Is>
+int TouchAll(V& v, std::index_sequence<Is...>) {
+    return (Touch<Is>(v) + ...);
+}
+
+int main() {
+    V v;
+    return TouchAll(v, std::make_index_sequence<ALTERNATIVES>{}) == 0;
+}
+
+// NOLINTEND
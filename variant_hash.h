@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <ranges>
+#include <span>
+
+#include "variant.h"
+
+// Hashing of many variants at once, with the same results as
+// std::hash<Variant>. When every alternative is bit_hashable, the key of each
+// element is read straight from the storage and cut to the size of its
+// alternative with per-index tables, so the loop has no branch on the index
+// and does not dispatch once per element.
+
+namespace variant_util {
+// Whether all variants of Types can be hashed from their raw storage bytes.
+template <typename... Types>
+constexpr bool bit_hash_batch_v =
+    (bit_hashable<std::remove_const_t<Types>> && ...) &&
+    std::endian::native == std::endian::little;
+
+// Per index tables of the batch path. The entry after the last alternative
+// is used for valueless variants.
+template <typename... Types>
+struct bit_hash_tables {
+    static constexpr size_t COUNT = sizeof...(Types);
+    static constexpr size_t STORAGE_BYTES = std::max({sizeof(Types)...});
+
+    template <typename T>
+    static constexpr uint64_t mask =
+        sizeof(T) == sizeof(uint64_t) ? ~uint64_t{0}
+                                      : (uint64_t{1} << (8 * sizeof(T))) - 1;
+
+    // Bit pattern of -0.0, which is hashed as 0. Integral alternatives use 0,
+    // which makes the replacement a no-op.
+    template <typename T>
+    static constexpr uint64_t negative_zero =
+        std::is_floating_point_v<T> ? uint64_t{1} << (8 * sizeof(T) - 1) : 0;
+
+    static constexpr std::array<uint64_t, COUNT + 1> masks = {mask<Types>...,
+                                                              0};
+    static constexpr std::array<uint64_t, COUNT + 1> negative_zeros = {
+        negative_zero<Types>..., 0};
+    static constexpr std::array<uint64_t, COUNT + 1> salts = [] {
+        std::array<uint64_t, COUNT + 1> salts{};
+        for (size_t i = 0; i < COUNT; ++i) {
+            salts[i] = i * HASH_INDEX_SALT;
+        }
+        salts[COUNT] = NPOS * HASH_INDEX_SALT;
+        return salts;
+    }();
+};
+
+template <typename... Types>
+void hash_variants(const Variant<Types...>* values, size_t size,
+                   size_t* out) {
+    if constexpr (bit_hash_batch_v<Types...>) {
+        using tables = bit_hash_tables<Types...>;
+        for (size_t i = 0; i < size; ++i) {
+            const Variant<Types...>& v = values[i];
+            size_t index = std::min(v.index(), tables::COUNT);
+            // All alternatives start at the beginning of the storage.
+            uint64_t key = 0;
+            std::memcpy(&key, VariantAccess::storage_address(v),
+                        tables::STORAGE_BYTES);
+            key &= tables::masks[index];
+            key &= -static_cast<uint64_t>(key != tables::negative_zeros[index]);
+            out[i] = mix_hash(key ^ tables::salts[index]);
+        }
+    } else {
+        std::hash<Variant<Types...>> hash;
+        for (size_t i = 0; i < size; ++i) {
+            out[i] = hash(values[i]);
+        }
+    }
+}
+}  // namespace variant_util
+
+// out[i] becomes std::hash<Variant>{}(values[i]) for every element of
+// values, which out must have room for.
+template <std::ranges::contiguous_range Range>
+    requires std::ranges::sized_range<Range>
+void HashVariants(const Range& values, std::span<size_t> out) {
+    assert(out.size() >= std::ranges::size(values));
+    variant_util::hash_variants(std::ranges::data(values),
+                                std::ranges::size(values), out.data());
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+// Memory resources for variants built and torn down in bulk, such as trees
+// of Boxed alternatives: give a Boxed a std::pmr::polymorphic_allocator over
+// one of them, or pass one to Variant::emplace(std::allocator_arg, ...).
+// Neither is thread safe.
+
+// Bump pointer arena: an allocation moves a pointer forward in the current
+// block, deallocate does nothing, and all the memory is returned at once by
+// release() or the destructor. Blocks come from upstream and double in size,
+// starting with the initial buffer when one is given.
+class ArenaResource : public std::pmr::memory_resource {
+  public:
+    explicit ArenaResource(
+        std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+        : upstream_(upstream) {}
+
+    ArenaResource(void* buffer, size_t size,
+                  std::pmr::memory_resource* upstream =
+                      std::pmr::get_default_resource())
+        : upstream_(upstream),
+          initial_(static_cast<std::byte*>(buffer)),
+          initial_size_(size),
+          cursor_(initial_),
+          end_(initial_ + size),
+          next_size_(std::max(size, MIN_BLOCK_SIZE)) {}
+
+    ArenaResource(const ArenaResource&) = delete;
+    ArenaResource& operator=(const ArenaResource&) = delete;
+
+    ~ArenaResource() override {
+        release();
+    }
+
+    // Frees every block taken from upstream and starts over from the
+    // initial buffer.
+    void release() {
+        while (blocks_ != nullptr) {
+            Block* block = std::exchange(blocks_, blocks_->next);
+            upstream_->deallocate(block, block->size, alignof(Block));
+        }
+        cursor_ = initial_;
+        end_ = initial_ + initial_size_;
+        next_size_ = std::max(initial_size_, MIN_BLOCK_SIZE);
+    }
+
+    std::pmr::memory_resource* upstream_resource() const {
+        return upstream_;
+    }
+
+  private:
+    static constexpr size_t MIN_BLOCK_SIZE = 4096;
+
+    // Header at the start of each block taken from upstream.
+    struct Block {
+        Block* next;
+        size_t size;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        std::byte* ptr = align_up(cursor_, alignment);
+        if (static_cast<size_t>(end_ - cursor_) <
+            static_cast<size_t>(ptr - cursor_) + bytes) [[unlikely]] {
+            grow(bytes, alignment);
+            ptr = align_up(cursor_, alignment);
+        }
+        cursor_ = ptr + bytes;
+        return ptr;
+    }
+
+    void do_deallocate(void* /*ptr*/, size_t /*bytes*/,
+                       size_t /*alignment*/) override {}
+
+    bool do_is_equal(
+        const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    static std::byte* align_up(std::byte* ptr, size_t alignment) {
+        auto address = reinterpret_cast<uintptr_t>(ptr);
+        size_t padding = -address & (alignment - 1);
+        return ptr + padding;
+    }
+
+    void grow(size_t bytes, size_t alignment) {
+        size_t size = std::max(next_size_, sizeof(Block) + bytes + alignment);
+        auto* block = static_cast<Block*>(
+            upstream_->allocate(size, alignof(Block)));
+        *block = Block{blocks_, size};
+        blocks_ = block;
+        cursor_ = reinterpret_cast<std::byte*>(block + 1);
+        end_ = reinterpret_cast<std::byte*>(block) + size;
+        next_size_ = size * 2;
+    }
+
+    std::pmr::memory_resource* upstream_;
+    std::byte* initial_ = nullptr;
+    size_t initial_size_ = 0;
+    std::byte* cursor_ = nullptr;
+    std::byte* end_ = nullptr;
+    size_t next_size_ = MIN_BLOCK_SIZE;
+    Block* blocks_ = nullptr;
+};
+
+// Pool of fixed size blocks: requests are rounded up to a multiple of
+// SIZE_CLASS bytes, and each size class keeps a free list of the blocks
+// given back to it, so that the nodes of a tree which is built and torn
+// down over and over are recycled without going upstream. A size class is
+// refilled with a whole chunk of blocks at a time. Requests larger than
+// MAX_POOLED_SIZE, or aligned beyond SIZE_CLASS, go straight upstream.
+class PoolResource : public std::pmr::memory_resource {
+  public:
+    static constexpr size_t SIZE_CLASS = 16;
+    static constexpr size_t MAX_POOLED_SIZE = 512;
+
+    explicit PoolResource(
+        std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+        : upstream_(upstream) {}
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    ~PoolResource() override {
+        release();
+    }
+
+    // Frees every chunk, including blocks still in use.
+    void release() {
+        while (chunks_ != nullptr) {
+            Chunk* chunk = std::exchange(chunks_, chunks_->next);
+            upstream_->deallocate(chunk, chunk->size, alignof(Chunk));
+        }
+        free_lists_ = {};
+        next_chunk_blocks_ = {};
+    }
+
+    std::pmr::memory_resource* upstream_resource() const {
+        return upstream_;
+    }
+
+  private:
+    static constexpr size_t CLASS_COUNT = MAX_POOLED_SIZE / SIZE_CLASS;
+    static constexpr size_t MIN_CHUNK_BLOCKS = 32;
+    static constexpr size_t MAX_CHUNK_BYTES = size_t{1} << 20;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    // Header at the start of each chunk, padded to keep the blocks after it
+    // aligned to SIZE_CLASS.
+    struct alignas(SIZE_CLASS) Chunk {
+        Chunk* next;
+        size_t size;
+    };
+
+    static bool pooled(size_t bytes, size_t alignment) {
+        return bytes <= MAX_POOLED_SIZE && alignment <= SIZE_CLASS;
+    }
+
+    static size_t size_class(size_t bytes) {
+        return bytes == 0 ? 0 : (bytes - 1) / SIZE_CLASS;
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        if (!pooled(bytes, alignment)) [[unlikely]] {
+            return upstream_->allocate(bytes, alignment);
+        }
+        size_t cls = size_class(bytes);
+        if (free_lists_[cls] == nullptr) [[unlikely]] {
+            refill(cls);
+        }
+        FreeBlock* block = free_lists_[cls];
+        free_lists_[cls] = block->next;
+        return block;
+    }
+
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override {
+        if (!pooled(bytes, alignment)) [[unlikely]] {
+            upstream_->deallocate(ptr, bytes, alignment);
+            return;
+        }
+        size_t cls = size_class(bytes);
+        free_lists_[cls] = ::new (ptr) FreeBlock{free_lists_[cls]};
+    }
+
+    bool do_is_equal(
+        const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    // Each refill of a size class takes twice as many blocks as the last
+    // one, up to MAX_CHUNK_BYTES per chunk.
+    void refill(size_t cls) {
+        size_t block_size = (cls + 1) * SIZE_CLASS;
+        size_t blocks = std::max(next_chunk_blocks_[cls], MIN_CHUNK_BLOCKS);
+        next_chunk_blocks_[cls] =
+            std::min(blocks * 2, MAX_CHUNK_BYTES / block_size);
+        size_t size = sizeof(Chunk) + blocks * block_size;
+        auto* chunk = static_cast<Chunk*>(
+            upstream_->allocate(size, alignof(Chunk)));
+        *chunk = Chunk{chunks_, size};
+        chunks_ = chunk;
+        auto* first = reinterpret_cast<std::byte*>(chunk + 1);
+        // Threaded back to front, so that blocks are handed out in address
+        // order.
+        FreeBlock* head = free_lists_[cls];
+        for (size_t i = blocks; i > 0; --i) {
+            head = ::new (first + (i - 1) * block_size) FreeBlock{head};
+        }
+        free_lists_[cls] = head;
+    }
+
+    std::pmr::memory_resource* upstream_;
+    std::array<FreeBlock*, CLASS_COUNT> free_lists_{};
+    std::array<size_t, CLASS_COUNT> next_chunk_blocks_{};
+    Chunk* chunks_ = nullptr;
+};
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <ranges>
+#include <span>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VARIANT_TAGS_X86 1
+#endif
+
+#include "variant.h"
+
+// Scans over compact buffers of alternative indices ("tags"), one byte per
+// element, as kept by VariantVector::tags() or built from any range of
+// variants by CollectTags. Each scan has a scalar kernel and, on x86, SSE2
+// and AVX2 kernels; the widest one the CPU supports is picked at runtime.
+
+namespace variant_util {
+enum class TagKernel { SCALAR, SSE2, AVX2 };
+
+inline TagKernel detect_tag_kernel() {
+#ifdef VARIANT_TAGS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return TagKernel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return TagKernel::SSE2;
+    }
+#endif
+    return TagKernel::SCALAR;
+}
+
+inline TagKernel active_tag_kernel() {
+    static const TagKernel kernel = detect_tag_kernel();
+    return kernel;
+}
+
+// Histograms of more alternatives than this are counted in one scalar pass
+// rather than in one vector pass per alternative.
+constexpr size_t TAG_VECTOR_PASSES_LIMIT = 16;
+
+inline size_t count_tag_scalar(const uint8_t* tags, size_t begin, size_t end,
+                               uint8_t tag) {
+    size_t count = 0;
+    for (size_t i = begin; i < end; ++i) {
+        count += tags[i] == tag;
+    }
+    return count;
+}
+
+inline size_t select_tag_scalar(const uint8_t* tags, size_t begin, size_t end,
+                                uint8_t tag, size_t* out) {
+    size_t count = 0;
+    for (size_t i = begin; i < end; ++i) {
+        if (tags[i] == tag) {
+            out[count++] = i;
+        }
+    }
+    return count;
+}
+
+#ifdef VARIANT_TAGS_X86
+// Matches are counted per byte lane by subtracting the all-ones compare
+// result, and folded into 64-bit sums with sad every 255 blocks, before a
+// lane can overflow.
+[[gnu::target("sse2")]] inline size_t count_tag_sse2(const uint8_t* tags,
+                                                     size_t size,
+                                                     uint8_t tag) {
+    const __m128i needle = _mm_set1_epi8(static_cast<char>(tag));
+    const __m128i zero = _mm_setzero_si128();
+    __m128i total = zero;
+    size_t i = 0;
+    while (i + 16 <= size) {
+        __m128i lanes = zero;
+        for (size_t block = 0; block < 255 && i + 16 <= size;
+             ++block, i += 16) {
+            __m128i data =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(tags + i));
+            lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(data, needle));
+        }
+        total = _mm_add_epi64(total, _mm_sad_epu8(lanes, zero));
+    }
+    uint64_t sums[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), total);
+    return sums[0] + sums[1] + count_tag_scalar(tags, i, size, tag);
+}
+
+[[gnu::target("avx2")]] inline size_t count_tag_avx2(const uint8_t* tags,
+                                                     size_t size,
+                                                     uint8_t tag) {
+    const __m256i needle = _mm256_set1_epi8(static_cast<char>(tag));
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i total = zero;
+    size_t i = 0;
+    while (i + 32 <= size) {
+        __m256i lanes = zero;
+        for (size_t block = 0; block < 255 && i + 32 <= size;
+             ++block, i += 32) {
+            __m256i data =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tags + i));
+            lanes = _mm256_sub_epi8(lanes, _mm256_cmpeq_epi8(data, needle));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(lanes, zero));
+    }
+    uint64_t sums[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums), total);
+    return sums[0] + sums[1] + sums[2] + sums[3] +
+           count_tag_scalar(tags, i, size, tag);
+}
+
+// Positions are extracted from the compare bit mask one set bit at a time.
+[[gnu::target("sse2")]] inline size_t select_tag_sse2(const uint8_t* tags,
+                                                      size_t size, uint8_t tag,
+                                                      size_t* out) {
+    const __m128i needle = _mm_set1_epi8(static_cast<char>(tag));
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i data =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(tags + i));
+        auto mask = static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(data, needle)));
+        while (mask != 0) {
+            out[count++] = i + static_cast<size_t>(__builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    return count + select_tag_scalar(tags, i, size, tag, out + count);
+}
+
+[[gnu::target("avx2")]] inline size_t select_tag_avx2(const uint8_t* tags,
+                                                      size_t size, uint8_t tag,
+                                                      size_t* out) {
+    const __m256i needle = _mm256_set1_epi8(static_cast<char>(tag));
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i data =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tags + i));
+        auto mask = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(data, needle)));
+        while (mask != 0) {
+            out[count++] = i + static_cast<size_t>(__builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    return count + select_tag_scalar(tags, i, size, tag, out + count);
+}
+#endif
+
+inline size_t count_tag(TagKernel kernel, const uint8_t* tags, size_t size,
+                        uint8_t tag) {
+    switch (kernel) {
+#ifdef VARIANT_TAGS_X86
+        case TagKernel::AVX2:
+            return count_tag_avx2(tags, size, tag);
+        case TagKernel::SSE2:
+            return count_tag_sse2(tags, size, tag);
+#endif
+        default:
+            return count_tag_scalar(tags, 0, size, tag);
+    }
+}
+
+// Writes exactly as many positions as there are matches.
+inline size_t select_tag(TagKernel kernel, const uint8_t* tags, size_t size,
+                         uint8_t tag, size_t* out) {
+    switch (kernel) {
+#ifdef VARIANT_TAGS_X86
+        case TagKernel::AVX2:
+            return select_tag_avx2(tags, size, tag, out);
+        case TagKernel::SSE2:
+            return select_tag_sse2(tags, size, tag, out);
+#endif
+        default:
+            return select_tag_scalar(tags, 0, size, tag, out);
+    }
+}
+
+// Four sets of counters, so that a run of equal tags does not make every
+// increment wait for the previous one.
+inline void tag_histogram_scalar(const uint8_t* tags, size_t size,
+                                 std::span<size_t> counts) {
+    std::array<std::array<size_t, 256>, 4> lanes{};
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        ++lanes[0][tags[i]];
+        ++lanes[1][tags[i + 1]];
+        ++lanes[2][tags[i + 2]];
+        ++lanes[3][tags[i + 3]];
+    }
+    for (; i < size; ++i) {
+        ++lanes[0][tags[i]];
+    }
+    for (size_t tag = 0; tag < counts.size() && tag < 256; ++tag) {
+        counts[tag] =
+            lanes[0][tag] + lanes[1][tag] + lanes[2][tag] + lanes[3][tag];
+    }
+}
+
+inline void tag_histogram(TagKernel kernel, const uint8_t* tags, size_t size,
+                          std::span<size_t> counts) {
+    if (kernel == TagKernel::SCALAR ||
+        counts.size() > TAG_VECTOR_PASSES_LIMIT) {
+        tag_histogram_scalar(tags, size, counts);
+        return;
+    }
+    for (size_t tag = 0; tag < counts.size(); ++tag) {
+        counts[tag] = count_tag(kernel, tags, size, static_cast<uint8_t>(tag));
+    }
+}
+
+// A counting sort. The scatter stays scalar: one select pass per
+// alternative was measured slower than it with as few as five alternatives.
+// Tags from alternatives up share the last bucket, whose start is the number
+// of tags counted by the histogram.
+inline void partition_by_tag(TagKernel kernel, const uint8_t* tags,
+                             size_t size, size_t alternatives, size_t* order) {
+    std::vector<size_t> starts(alternatives + 1);
+    tag_histogram(kernel, tags, size,
+                  std::span<size_t>(starts).subspan(1, alternatives));
+    for (size_t tag = 1; tag <= alternatives; ++tag) {
+        starts[tag] += starts[tag - 1];
+    }
+    for (size_t i = 0; i < size; ++i) {
+        order[starts[std::min<size_t>(tags[i], alternatives)]++] = i;
+    }
+}
+}  // namespace variant_util
+
+// Compact tag buffer of a range of variants: the index() of each element,
+// in order. Valueless elements get the tag 255, which no alternative has.
+template <std::ranges::input_range Range>
+std::vector<uint8_t> CollectTags(const Range& range) {
+    using V = std::remove_cvref_t<std::ranges::range_reference_t<Range>>;
+    static_assert(variant_size<V>::value < UINT8_MAX,
+                  "Tags of more than 254 alternatives do not fit a byte!");
+    std::vector<uint8_t> tags;
+    if constexpr (std::ranges::sized_range<Range>) {
+        tags.reserve(std::ranges::size(range));
+    }
+    for (const auto& v : range) {
+        tags.push_back(static_cast<uint8_t>(v.index()));
+    }
+    return tags;
+}
+
+// Number of elements holding the alternative tag.
+inline size_t CountTag(std::span<const uint8_t> tags, uint8_t tag) {
+    return variant_util::count_tag(variant_util::active_tag_kernel(),
+                                   tags.data(), tags.size(), tag);
+}
+
+// counts[t] becomes the number of elements holding the alternative t, for
+// every t < counts.size().
+inline void TagHistogram(std::span<const uint8_t> tags,
+                         std::span<size_t> counts) {
+    variant_util::tag_histogram(variant_util::active_tag_kernel(), tags.data(),
+                                tags.size(), counts);
+}
+
+// Writes the positions of the elements holding the alternative tag, in
+// increasing order, to out and returns how many there are. out must have
+// room for tags.size() positions.
+inline size_t SelectTag(std::span<const uint8_t> tags, uint8_t tag,
+                        std::span<size_t> out) {
+    assert(out.size() >= tags.size());
+    return variant_util::select_tag(variant_util::active_tag_kernel(),
+                                    tags.data(), tags.size(), tag, out.data());
+}
+
+// Writes to order the positions of all elements grouped by alternative:
+// those holding alternative 0 first, then alternative 1, and so on, each
+// group in increasing order. Elements whose tag is not below alternatives,
+// such as the valueless ones of CollectTags, come last, also in increasing
+// order. order must have room for tags.size() positions.
+inline void PartitionByTag(std::span<const uint8_t> tags, size_t alternatives,
+                           std::span<size_t> order) {
+    assert(order.size() >= tags.size());
+    variant_util::partition_by_tag(variant_util::active_tag_kernel(),
+                                   tags.data(), tags.size(), alternatives,
+                                   order.data());
+}
@@ -1,6 +1,18 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <compare>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
 #include <type_traits>
+#include <unordered_set>
 #include <variant>
 #include <vector>
 
@@ -8,9 +20,65 @@
 //#pragma GCC diagnostic ignored "-Wuninitialized"
 
 #include "variant.h"
+#include "variant_algorithm.h"
+#include "variant_atomic.h"
+#include "variant_hash.h"
+#include "variant_memory.h"
+#include "variant_tags.h"
+#include "variant_vector.h"
 
 // NOLINTBEGIN
 
+// Counts every global allocation so tests can assert that an operation does
+// not allocate.
+static size_t allocation_count = 0;
+
+[[gnu::noinline]] void* operator new(size_t size) {
+    ++allocation_count;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+[[gnu::noinline]] void operator delete(void* ptr, size_t /*unused*/) noexcept {
+    std::free(ptr);
+}
+
+// Alternative that only the tests of valueless variants use. Variants
+// holding it opt out of the never valueless policy, so that MakeValueless
+// can make them valueless without changing the policy of any variant the
+// other tests use.
+enum class Fragile { VALUE };
+
+template <>
+struct variant_never_valueless<Variant<int, Fragile>> : std::false_type {};
+
+template <>
+struct variant_never_valueless<Variant<int, std::string, Fragile>>
+    : std::false_type {};
+
+// A variant whose int alternative failed to be emplaced.
+template <typename V>
+V MakeValueless() {
+    V v;
+    try {
+        struct Thrower {
+            operator int() const {
+                throw 1;
+            }
+        };
+        v.template emplace<int>(Thrower());
+    } catch (int) {
+        // ok
+    }
+    return v;
+}
+
 void BasicTest() {
 
     Variant<int, std::string, double> v = 5;
@@ -394,6 +462,1700 @@ void TestMultipleVisit() {
     }
 }
 
+template <size_t N, size_t... Is>
+auto MakeManyAlternatives(std::index_sequence<Is...>)
+    -> Variant<std::integral_constant<size_t, N + Is>...>;
+
+template <size_t Count>
+using ManyAlternatives =
+    decltype(MakeManyAlternatives<0>(std::make_index_sequence<Count>{}));
+
+void TestIndexSize() {
+    static_assert(sizeof(Variant<int, float>) == 8);
+    static_assert(sizeof(Variant<char, bool>) == 2);
+    static_assert(sizeof(Variant<double, char>) == 16);
+    static_assert(sizeof(Variant<int, float>) ==
+                  sizeof(std::variant<int, float>));
+    static_assert(alignof(Variant<char, double>) == alignof(double));
+
+    static_assert(sizeof(ManyAlternatives<254>) == 2);
+    static_assert(sizeof(ManyAlternatives<255>) == 4);
+
+    struct ThrowOnCopy {
+        ThrowOnCopy() = default;
+        ThrowOnCopy(const ThrowOnCopy&) {
+            throw 1;
+        }
+        ThrowOnCopy& operator=(const ThrowOnCopy&) = default;
+    };
+
+    Variant<int, ThrowOnCopy> v = 7;
+    assert(v.index() == 0);
+    assert(!v.valueless_by_exception());
+
+    try {
+        ThrowOnCopy t;
+        v.emplace<ThrowOnCopy>(t);
+        assert(false);
+    } catch (int) {
+        // ok
+    }
+
+    assert(v.valueless_by_exception());
+    assert(v.index() == NPOS);
+
+    // So does a converting assignment, rather than keep the index of the
+    // alternative it has already destroyed.
+    Variant<std::string, ThrowOnCopy> text = std::string("text");
+    try {
+        ThrowOnCopy t;
+        text = t;
+        assert(false);
+    } catch (int) {
+        // ok
+    }
+
+    assert(text.valueless_by_exception());
+    assert(text.index() == NPOS);
+}
+
+void TestTrivialSpecialMembers() {
+    using Trivial = Variant<int, double, char*>;
+    static_assert(std::is_trivially_copyable_v<Trivial>);
+    static_assert(std::is_trivially_copy_constructible_v<Trivial>);
+    static_assert(std::is_trivially_move_constructible_v<Trivial>);
+    static_assert(std::is_trivially_copy_assignable_v<Trivial>);
+    static_assert(std::is_trivially_move_assignable_v<Trivial>);
+    static_assert(std::is_trivially_destructible_v<Trivial>);
+
+    using NonTrivial = Variant<int, std::string>;
+    static_assert(!std::is_trivially_copyable_v<NonTrivial>);
+    static_assert(!std::is_trivially_destructible_v<NonTrivial>);
+    static_assert(std::is_copy_constructible_v<NonTrivial>);
+
+    struct TrivialDtorOnly {
+        TrivialDtorOnly() = default;
+        TrivialDtorOnly(const TrivialDtorOnly&) {}
+    };
+    using Mixed = Variant<int, TrivialDtorOnly>;
+    static_assert(std::is_trivially_destructible_v<Mixed>);
+    static_assert(!std::is_trivially_copy_constructible_v<Mixed>);
+    static_assert(!std::is_trivially_copy_assignable_v<Mixed>);
+
+    static_assert(!std::is_copy_constructible_v<
+                  Variant<int, std::unique_ptr<int>>>);
+    static_assert(std::is_move_constructible_v<
+                  Variant<int, std::unique_ptr<int>>>);
+
+    Trivial a = 3.5;
+    Trivial b = a;
+    assert(Get<double>(b) == 3.5);
+    b = 7;
+    a = b;
+    assert(Get<int>(a) == 7);
+
+    std::vector<Trivial> vec(3, Trivial(1));
+    vec.resize(100);
+    assert(Get<int>(vec[2]) == 1);
+    assert(Get<int>(vec[99]) == 0);
+
+    vec.clear();
+    for (int i = 0; i < 100; ++i) {
+        vec.push_back(Trivial(i));
+    }
+    for (int i = 0; i < 100; ++i) {
+        assert(Get<int>(vec[i]) == i);
+    }
+
+    Mixed m = 5;
+    Mixed mm = m;
+    assert(Get<int>(mm) == 5);
+}
+
+void TestVisitDispatch() {
+    auto index_of = [](auto alternative) {
+        return decltype(alternative)::value;
+    };
+
+    ManyAlternatives<32> small;
+    assert(Visit(index_of, small) == 0);
+    small.emplace<31>();
+    assert(Visit(index_of, small) == 31);
+    small.emplace<17>();
+    assert(Visit(index_of, small) == 17);
+
+    ManyAlternatives<40> large;
+    assert(Visit(index_of, large) == 0);
+    large.emplace<39>();
+    assert(Visit(index_of, large) == 39);
+    large.emplace<33>();
+    assert(Visit(index_of, large) == 33);
+
+    struct ThrowOnCopy {
+        ThrowOnCopy() = default;
+        ThrowOnCopy(const ThrowOnCopy&) {
+            throw 1;
+        }
+    };
+
+    Variant<int, ThrowOnCopy> v;
+    try {
+        ThrowOnCopy t;
+        v.emplace<ThrowOnCopy>(t);
+    } catch (int) {
+        // ok
+    }
+    assert(v.valueless_by_exception());
+
+    try {
+        Visit([](const auto&) {}, v);
+        assert(false);
+    } catch (const std::runtime_error&) {
+        // ok
+    }
+}
+
+void TestFlatMultipleVisit() {
+    ManyAlternatives<3> a;
+    ManyAlternatives<5> b;
+    ManyAlternatives<4> c;
+
+    auto combine = [](auto x, auto y, auto z) {
+        return decltype(x)::value * 100 + decltype(y)::value * 10 +
+               decltype(z)::value;
+    };
+
+    assert(Visit(combine, a, b, c) == 0);
+    a.emplace<2>();
+    b.emplace<4>();
+    c.emplace<3>();
+    assert(Visit(combine, a, b, c) == 243);
+    b.emplace<1>();
+    assert(Visit(combine, a, b, c) == 213);
+    assert(Visit(combine, c, a, b) == 321);
+
+    struct Circle {};
+    struct Square {};
+    struct Triangle {};
+    using Shape = Variant<Circle, Square, Triangle>;
+
+    auto collide = Overload{
+        [](Circle, Circle) {
+            return 1;
+        },
+        [](Circle, Square) {
+            return 2;
+        },
+        [](Square, Triangle) {
+            return 3;
+        },
+    };
+
+    Shape lhs = Circle();
+    Shape rhs = Square();
+    assert(VisitPartial(collide, lhs, rhs) == 2);
+    rhs = Circle();
+    assert(VisitPartial(collide, lhs, rhs) == 1);
+    lhs = Square();
+    rhs = Triangle();
+    assert(VisitPartial(collide, lhs, rhs) == 3);
+
+    try {
+        VisitPartial(collide, rhs, lhs);
+        assert(false);
+    } catch (const std::runtime_error&) {
+        // ok
+    }
+}
+
+// Alternative that tracks how many of its instances are alive.
+template <size_t I>
+struct Counted {
+    static inline int alive = 0;
+    int value = static_cast<int>(I);
+
+    Counted() {
+        ++alive;
+    }
+    Counted(const Counted& other) : value(other.value) {
+        ++alive;
+    }
+    Counted& operator=(const Counted& other) = default;
+    ~Counted() {
+        --alive;
+    }
+};
+
+template <size_t... Is>
+auto MakeCountedVariant(std::index_sequence<Is...>) -> Variant<Counted<Is>...>;
+
+template <size_t Count>
+using CountedVariant =
+    decltype(MakeCountedVariant(std::make_index_sequence<Count>{}));
+
+template <size_t Count>
+void TestSingleDispatchLifetimeOf() {
+    using V = CountedVariant<Count>;
+    constexpr size_t LAST = Count - 1;
+    {
+        V v;
+        v.template emplace<LAST>();
+        assert(Counted<LAST>::alive == 1);
+
+        V copy = v;
+        assert(Counted<LAST>::alive == 2);
+        assert(Get<LAST>(copy).value == static_cast<int>(LAST));
+
+        V moved = std::move(copy);
+        assert(Counted<LAST>::alive == 3);
+
+        copy = v;
+        assert(Counted<LAST>::alive == 3);
+
+        v.template emplace<1>();
+        assert(Counted<LAST>::alive == 2);
+        assert(Counted<1>::alive == 1);
+
+        moved = v;
+        assert(Counted<LAST>::alive == 1);
+        assert(Counted<1>::alive == 2);
+    }
+    assert(Counted<0>::alive == 0);
+    assert(Counted<1>::alive == 0);
+    assert(Counted<LAST>::alive == 0);
+}
+
+void TestSingleDispatchLifetime() {
+    TestSingleDispatchLifetimeOf<4>();
+    TestSingleDispatchLifetimeOf<40>();
+}
+
+void TestSameAlternativeAssignment() {
+    using V = Variant<int, std::string, std::vector<int>>;
+
+    V text = std::string(100, 'a');
+    V other_text = std::string(80, 'b');
+    V numbers = std::vector<int>(50, 1);
+    V other_numbers = std::vector<int>(40, 2);
+
+    size_t before = allocation_count;
+    for (int i = 0; i < 100; ++i) {
+        text = other_text;
+        numbers = other_numbers;
+        other_text = text;
+        other_numbers = numbers;
+    }
+    other_text = std::move(text);
+    other_numbers = std::move(numbers);
+    text = std::move(other_text);
+    numbers = std::move(other_numbers);
+    assert(allocation_count == before);
+    assert(Get<std::string>(text) == std::string(80, 'b'));
+    assert(Get<std::vector<int>>(numbers) == std::vector<int>(40, 2));
+
+    const V& same_text = text;
+    text = same_text;
+    assert(Get<std::string>(text) == std::string(80, 'b'));
+
+    text = numbers;
+    assert(Get<std::vector<int>>(text) == std::vector<int>(40, 2));
+    text = V(7);
+    assert(Get<int>(text) == 7);
+
+    Variant<const std::string, int> fixed = std::string("first");
+    Variant<const std::string, int> replacement = std::string("second");
+    fixed = replacement;
+    assert(Get<0>(fixed) == "second");
+    const auto& same_fixed = fixed;
+    fixed = same_fixed;
+    assert(Get<0>(fixed) == "second");
+}
+
+// Counts copies; moving it is noexcept and free.
+struct CopyCounted {
+    static inline int copies = 0;
+
+    CopyCounted() = default;
+    CopyCounted(const CopyCounted& /*unused*/) {
+        ++copies;
+    }
+    CopyCounted(CopyCounted&& /*unused*/) noexcept = default;
+    CopyCounted& operator=(const CopyCounted& /*unused*/) {
+        ++copies;
+        return *this;
+    }
+    CopyCounted& operator=(CopyCounted&& /*unused*/) noexcept = default;
+};
+
+void TestNoexcept() {
+    struct ThrowingMove {
+        ThrowingMove() = default;
+        ThrowingMove(const ThrowingMove&) = default;
+        ThrowingMove(ThrowingMove&&) noexcept(false) {}
+        ThrowingMove& operator=(ThrowingMove&&) noexcept(false) {
+            return *this;
+        }
+    };
+
+    using Text = Variant<int, std::string, std::vector<int>>;
+    static_assert(std::is_nothrow_move_constructible_v<Text>);
+    static_assert(std::is_nothrow_move_assignable_v<Text>);
+    static_assert(std::is_nothrow_destructible_v<Text>);
+    static_assert(std::is_nothrow_swappable_v<Text>);
+    static_assert(std::is_nothrow_default_constructible_v<Text>);
+    static_assert(!std::is_nothrow_copy_constructible_v<Text>);
+    static_assert(std::is_nothrow_constructible_v<Text, std::string&&>);
+    static_assert(!std::is_nothrow_constructible_v<Text, const std::string&>);
+    static_assert(noexcept(std::declval<Text&>().emplace<int>(1)));
+    static_assert(noexcept(std::declval<Text&>().emplace<1>()));
+    static_assert(!noexcept(std::declval<Text&>().emplace<1>("abc")));
+
+    using Throwing = Variant<int, ThrowingMove>;
+    static_assert(!std::is_nothrow_move_constructible_v<Throwing>);
+    static_assert(!std::is_nothrow_move_assignable_v<Throwing>);
+    static_assert(!std::is_nothrow_swappable_v<Throwing>);
+
+    std::vector<Variant<int, CopyCounted>> values;
+    for (int i = 0; i < 1000; ++i) {
+        values.emplace_back(CopyCounted());
+    }
+    assert(CopyCounted::copies == 0);
+
+    Text a = std::string("abc");
+    Text b = std::vector<int>{1, 2};
+    swap(a, b);
+    assert(Get<std::vector<int>>(a) == std::vector<int>({1, 2}));
+    assert(Get<std::string>(b) == "abc");
+    b = std::string("def");
+    a = std::string("ghi");
+    a.swap(b);
+    assert(Get<std::string>(a) == "def");
+    assert(Get<std::string>(b) == "ghi");
+}
+
+struct Opcode {
+    int code;
+    int operands;
+};
+
+using Instruction = Variant<int, double, Opcode>;
+
+constexpr Instruction INSTRUCTIONS[] = {1, 2.5, Opcode{7, 2}, 4};
+
+constexpr int Weight(const Instruction& instruction) {
+    return Visit(Overload{
+                     [](int x) {
+                         return x;
+                     },
+                     [](double x) {
+                         return static_cast<int>(x * 2);
+                     },
+                     [](const Opcode& op) {
+                         return op.code * op.operands;
+                     },
+                 },
+                 instruction);
+}
+
+constexpr int TotalWeight() {
+    int total = 0;
+    for (const auto& instruction : INSTRUCTIONS) {
+        total += Weight(instruction);
+    }
+    return total;
+}
+
+constexpr size_t EmplaceAndCopy() {
+    Instruction v;
+    v.emplace<Opcode>(Opcode{3, 1});
+    Instruction copy = v;
+    copy.emplace<1>(1.5);
+    v = copy;
+    return v.index() * 10 + Get<Opcode>(Instruction(Opcode{4, 0})).code;
+}
+
+constexpr size_t NonTrivialAlternatives() {
+    Variant<int, std::string, std::vector<int>> v = std::string("abc");
+    size_t result = Get<std::string>(v).size();
+    v = std::vector<int>{1, 2, 3, 4};
+    result = result * 10 + Get<2>(v).size();
+    Variant<int, std::string, std::vector<int>> other = v;
+    other.emplace<std::string>("xy");
+    v.swap(other);
+    result = result * 10 + Get<std::string>(v).size();
+    auto both = [](const auto& lhs, const auto& rhs) {
+        return sizeof(lhs) + sizeof(rhs);
+    };
+    return result * 100 + Visit(both, v, other);
+}
+
+void TestConstexpr() {
+    static_assert(INSTRUCTIONS[0].index() == 0);
+    static_assert(INSTRUCTIONS[2].index() == 2);
+    static_assert(holds_alternative<double>(INSTRUCTIONS[1]));
+    static_assert(!holds_alternative<int>(INSTRUCTIONS[2]));
+    static_assert(Get<int>(INSTRUCTIONS[3]) == 4);
+    static_assert(Get<2>(INSTRUCTIONS[2]).operands == 2);
+    static_assert(Weight(INSTRUCTIONS[2]) == 14);
+    static_assert(TotalWeight() == 24);
+    static_assert(EmplaceAndCopy() == 14);
+    static_assert(NonTrivialAlternatives() ==
+                  34200 + sizeof(std::string) + sizeof(std::vector<int>));
+
+    constexpr ManyAlternatives<40> large = std::integral_constant<size_t, 35>();
+    static_assert(Visit(
+                      [](auto alternative) {
+                          return decltype(alternative)::value;
+                      },
+                      large) == 35);
+
+    assert(TotalWeight() == 24);
+}
+
+void TestGetIf() {
+    Variant<int, std::string, double> v = std::string("abc");
+
+    assert(GetIf<int>(&v) == nullptr);
+    assert(GetIf<0>(&v) == nullptr);
+    assert(*GetIf<std::string>(&v) == "abc");
+    GetIf<1>(&v)->append("d");
+    assert(Get<std::string>(v) == "abcd");
+
+    const auto& cv = v;
+    static_assert(
+        std::is_same_v<decltype(GetIf<std::string>(&cv)), const std::string*>);
+    static_assert(std::is_same_v<decltype(GetIf<2>(&v)), double*>);
+    static_assert(noexcept(GetIf<int>(&cv)));
+    assert(GetIf<1>(&cv) == &Get<1>(cv));
+    assert(GetIf<double>(&cv) == nullptr);
+
+    Variant<int, std::string, double>* null = nullptr;
+    assert(GetIf<int>(null) == nullptr);
+
+    if (v.index() == 1) {
+        assert(UncheckedGet<1>(v) == "abcd");
+        assert(UncheckedGet<std::string>(cv) == "abcd");
+        std::string moved = UncheckedGet<std::string>(std::move(v));
+        assert(moved == "abcd");
+    }
+    static_assert(std::is_rvalue_reference_v<decltype(UncheckedGet<1>(
+                      std::move(v)))>);
+    static_assert(std::is_same_v<decltype(UncheckedGet<double>(cv)),
+                                 const double&>);
+
+    v = 2.5;
+    try {
+        Get<std::string>(v);
+        assert(false);
+    } catch (const std::runtime_error&) {
+        // ok
+    }
+
+    constexpr Variant<int, double> c = 1.5;
+    static_assert(GetIf<int>(&c) == nullptr);
+    static_assert(*GetIf<1>(&c) == 1.5);
+    static_assert(UncheckedGet<double>(c) == 1.5);
+}
+
+template <size_t... Is>
+auto MakeWideVariant(std::index_sequence<Is...>)
+    -> Variant<std::integral_constant<size_t, Is>..., std::string, double>;
+
+// Past FLAT_STORAGE_LIMIT, so stored in AlignedUnion.
+using WideVariant = decltype(MakeWideVariant(std::make_index_sequence<98>{}));
+
+void TestAlignedStorage() {
+    static_assert(variant_size<WideVariant>::value >
+                  variant_util::FLAT_STORAGE_LIMIT);
+    static_assert(sizeof(WideVariant) == sizeof(Variant<std::string, double>));
+    static_assert(alignof(WideVariant) == alignof(std::string));
+    static_assert(std::is_trivially_copyable_v<ManyAlternatives<100>>);
+    static_assert(!std::is_trivially_copyable_v<WideVariant>);
+    static_assert(std::is_nothrow_move_constructible_v<WideVariant>);
+
+    WideVariant v = std::string(40, 'a');
+    assert(v.index() == 98);
+    assert(Get<std::string>(v) == std::string(40, 'a'));
+
+    WideVariant copy = v;
+    Get<98>(copy).push_back('b');
+    assert(Get<std::string>(v).size() == 40);
+    assert(Get<std::string>(copy).size() == 41);
+
+    WideVariant moved = std::move(copy);
+    assert(Get<std::string>(moved).size() == 41);
+
+    v.emplace<99>(2.5);
+    assert(*GetIf<double>(&v) == 2.5);
+    assert(GetIf<std::string>(&v) == nullptr);
+    assert(Visit(
+               [](const auto& x) {
+                   return sizeof(x);
+               },
+               v) == sizeof(double));
+
+    swap(v, moved);
+    assert(Get<std::string>(v).size() == 41);
+    assert(Get<double>(moved) == 2.5);
+
+    using Fifty = std::integral_constant<size_t, 50>;
+    v = Fifty();
+    assert(v.index() == 50);
+    moved = v;
+    assert(holds_alternative<Fifty>(moved));
+
+    TestSingleDispatchLifetimeOf<70>();
+}
+
+template <size_t... Is>
+auto MakeIndexList(std::index_sequence<Is...>)
+    -> std::tuple<std::integral_constant<size_t, Is>...>;
+
+template <typename T, typename List>
+constexpr size_t IndexIn = 0;
+
+template <typename T, typename... Types>
+constexpr size_t IndexIn<T, std::tuple<Types...>> =
+    get_index_by_type_v<T, Types...>;
+
+template <size_t Index, typename List>
+struct TypeIn;
+
+template <size_t Index, typename... Types>
+struct TypeIn<Index, std::tuple<Types...>> {
+    using type = get_type_by_index_t<Index, Types...>;
+};
+
+void TestTypeListLookup() {
+    static_assert(get_index_by_type_v<int, char, int, double, int> == 1);
+    static_assert(get_index_by_type_v<float, char, int> == NPOS);
+    static_assert(get_index_by_type_v<int> == NPOS);
+    static_assert(
+        std::is_same_v<get_type_by_index_t<2, char, int, double>, double>);
+    static_assert(std::is_same_v<get_type_by_index_t<1, int, int>, int>);
+    static_assert(std::is_same_v<get_type_by_index_t<3, char, int>,
+                                 variant_util::Empty>);
+
+    // Deeper than the default template instantiation depth of either
+    // compiler, were the lookups recursive.
+    using Long = decltype(MakeIndexList(std::make_index_sequence<1500>{}));
+    static_assert(IndexIn<std::integral_constant<size_t, 1499>, Long> == 1499);
+    static_assert(TypeIn<1499, Long>::type::value == 1499);
+    static_assert(TypeIn<700, Long>::type::value == 700);
+}
+
+void TestVariantVector() {
+    using V = Variant<int, std::string, double>;
+    VariantVector<int, std::string, double> values;
+    assert(values.empty());
+
+    values.push_back(V(1));
+    values.push_back(V(std::string("two")));
+    const V three = 3.0;
+    values.push_back(three);
+    values.emplace_back<int>(4);
+    values.emplace_back<1>(5, 'x');
+    assert(values.size() == 5);
+
+    assert(values.index(1) == 1);
+    assert(values[0].index() == 0);
+    assert(Get<int>(values[0]) == 1);
+    assert(Get<1>(values[1]) == "two");
+    assert(Get<double>(values[2]) == 3.0);
+    assert(holds_alternative<std::string>(values[4]));
+    assert(!holds_alternative<int>(values[4]));
+    assert(GetIf<int>(values[1]) == nullptr);
+    assert(*GetIf<1>(values[4]) == "xxxxx");
+
+    try {
+        Get<double>(values[0]);
+        assert(false);
+    } catch (const std::runtime_error&) {
+        // ok
+    }
+
+    Get<int>(values[3]) += 10;
+    assert(Get<int>(values[3]) == 14);
+
+    V copy = values[1];
+    assert(Get<std::string>(copy) == "two");
+
+    std::vector<int> ints(values.alternative<int>().begin(),
+                          values.alternative<int>().end());
+    assert(ints == std::vector<int>({1, 14}));
+    assert(values.alternative<1>().size() == 2);
+    assert(values.alternative<double>()[0] == 3.0);
+
+    size_t total = 0;
+    for (auto element : values) {
+        total += Visit(Overload{
+                           [](int x) {
+                               return static_cast<size_t>(x);
+                           },
+                           [](const std::string& s) {
+                               return s.size();
+                           },
+                           [](double x) {
+                               return static_cast<size_t>(x);
+                           },
+                       },
+                       element);
+    }
+    assert(total == 1 + 3 + 3 + 14 + 5);
+
+    const auto& const_values = values;
+    static_assert(std::is_same_v<decltype(Get<1>(const_values[1])),
+                                 const std::string&>);
+    size_t strings = 0;
+    for (auto element : const_values) {
+        strings += holds_alternative<std::string>(element);
+    }
+    assert(strings == 2);
+
+    values.pop_back();
+    assert(values.size() == 4);
+    assert(values.alternative<std::string>().size() == 1);
+    values.emplace_back<std::string>("six");
+    assert(Get<std::string>(values[4]) == "six");
+
+    // A failed emplace leaves the vector as it was.
+    try {
+        values.emplace_back<std::string>(std::string().max_size() + 1, 'x');
+        assert(false);
+    } catch (const std::length_error&) {
+        // ok
+    }
+    assert(values.size() == 5);
+    assert(values.alternative<std::string>().size() == 2);
+
+    VariantVector<int, Fragile> fragile;
+    try {
+        fragile.push_back(MakeValueless<Variant<int, Fragile>>());
+        assert(false);
+    } catch (const std::runtime_error&) {
+        // ok
+    }
+    assert(fragile.empty());
+
+    values.clear();
+    assert(values.empty());
+    assert(values.alternative<int>().empty());
+
+    // Bool values are kept as bools, not as the bits of std::vector<bool>.
+    VariantVector<int, bool> flags;
+    flags.push_back(Variant<int, bool>(true));
+    flags.push_back(Variant<int, bool>(7));
+    bool& added = flags.emplace_back<bool>(false);
+    added = true;
+    for (int i = 0; i < 20; ++i) {
+        flags.emplace_back<1>(i % 2 == 0);
+    }
+    assert(flags.size() == 23);
+    assert(Get<1>(flags[0]));
+    assert(Get<bool>(flags[2]));
+    assert(Get<int>(flags[1]) == 7);
+    Get<1>(flags[0]) = false;
+
+    std::span<bool> bools = flags.alternative<bool>();
+    assert(bools.size() == 22);
+    assert(!bools[0] && bools[1] && bools[2] && !bools[3]);
+
+    size_t set = 0;
+    for (auto element : flags) {
+        set += Visit(Overload{
+                         [](int) {
+                             return size_t{0};
+                         },
+                         [](bool b) {
+                             return size_t{b};
+                         },
+                     },
+                     element);
+    }
+    assert(set == 11);
+
+    VariantVector<int, bool> flags_copy = flags;
+    flags.pop_back();
+    assert(flags_copy.alternative<1>().size() == 22);
+    assert(flags.alternative<1>().size() == 21);
+}
+
+void TestVisitAll() {
+    using V = Variant<int, std::string, double>;
+    std::vector<V> values = {1, std::string("a"), 2.5, 2, std::string("b"), 3};
+
+    std::vector<std::string> seen;
+    auto record = Overload{
+        [&](int x) {
+            seen.push_back("i" + std::to_string(x));
+        },
+        [&](const std::string& s) {
+            seen.push_back("s" + s);
+        },
+        [&](double) {
+            seen.push_back("d");
+        },
+    };
+
+    VisitAll(record, values);
+    assert(seen == std::vector<std::string>(
+                       {"i1", "i2", "i3", "sa", "sb", "d"}));
+
+    seen.clear();
+    VisitEach(record, values);
+    assert(seen == std::vector<std::string>(
+                       {"i1", "sa", "d", "i2", "sb", "i3"}));
+
+    VisitAll(Overload{
+                 [](int& x) {
+                     x *= 10;
+                 },
+                 [](auto&) {},
+             },
+             values);
+    assert(Get<int>(values[3]) == 20);
+    VisitEach(
+        [](auto& x) {
+            x += x;
+        },
+        values);
+    assert(Get<int>(values[5]) == 60);
+    assert(Get<std::string>(values[1]) == "aa");
+
+    const std::vector<V>& const_values = values;
+    size_t total = 0;
+    VisitEach(
+        [&](const auto& x) {
+            total += sizeof(x);
+        },
+        const_values);
+    assert(total == 3 * sizeof(int) + 2 * sizeof(std::string) + sizeof(double));
+
+    VariantVector<int, std::string, double> soa;
+    for (const auto& v : values) {
+        soa.push_back(v);
+    }
+    seen.clear();
+    VisitAll(record, soa);
+    assert(seen == std::vector<std::string>(
+                       {"i20", "i40", "i60", "saa", "sbb", "d"}));
+
+    std::vector<V> empty;
+    VisitAll(record, empty);
+    VisitEach(record, empty);
+
+    using F = Variant<int, Fragile>;
+    std::vector<F> fragile = {1, Fragile::VALUE, MakeValueless<F>()};
+    size_t visited = 0;
+    try {
+        VisitAll(
+            [&](const auto&) {
+                ++visited;
+            },
+            fragile);
+        assert(false);
+    } catch (const std::runtime_error&) {
+        // ok
+    }
+    assert(visited == 0);
+}
+
+void TestTagScans() {
+    using variant_util::TagKernel;
+
+    std::vector<uint8_t> tags;
+    uint32_t state = 7;
+    for (size_t i = 0; i < 1000; ++i) {
+        state = state * 1664525 + 1013904223;
+        tags.push_back(static_cast<uint8_t>((state >> 8) % 5));
+    }
+
+    std::vector<TagKernel> kernels = {TagKernel::SCALAR};
+    if (variant_util::active_tag_kernel() != TagKernel::SCALAR) {
+        kernels.push_back(TagKernel::SSE2);
+    }
+    if (variant_util::active_tag_kernel() == TagKernel::AVX2) {
+        kernels.push_back(TagKernel::AVX2);
+    }
+
+    // Every prefix length covers the vector blocks and the scalar tails.
+    for (size_t size : {0, 1, 15, 16, 31, 33, 100, 1000}) {
+        std::vector<size_t> expected_order;
+        std::array<size_t, 5> expected_counts{};
+        for (uint8_t tag = 0; tag < 5; ++tag) {
+            for (size_t i = 0; i < size; ++i) {
+                if (tags[i] == tag) {
+                    expected_order.push_back(i);
+                    ++expected_counts[tag];
+                }
+            }
+        }
+
+        for (TagKernel kernel : kernels) {
+            for (uint8_t tag = 0; tag < 6; ++tag) {
+                size_t expected = tag < 5 ? expected_counts[tag] : 0;
+                assert(variant_util::count_tag(kernel, tags.data(), size,
+                                               tag) == expected);
+
+                std::vector<size_t> positions(size);
+                size_t count = variant_util::select_tag(
+                    kernel, tags.data(), size, tag, positions.data());
+                assert(count == expected);
+                for (size_t i = 0; i < count; ++i) {
+                    assert(tags[positions[i]] == tag);
+                    assert(i == 0 || positions[i - 1] < positions[i]);
+                }
+            }
+
+            std::array<size_t, 5> counts{};
+            variant_util::tag_histogram(kernel, tags.data(), size, counts);
+            assert(counts == expected_counts);
+
+            std::vector<size_t> order(size);
+            variant_util::partition_by_tag(kernel, tags.data(), size, 5,
+                                           order.data());
+            assert(order == expected_order);
+
+            // Tags past the alternatives go last: here, those of 4.
+            variant_util::partition_by_tag(kernel, tags.data(), size, 4,
+                                           order.data());
+            assert(order == expected_order);
+        }
+    }
+
+    using V = Variant<int, std::string, double>;
+    std::vector<V> values = {1, std::string("a"), 2.5, 2, std::string("b")};
+    std::vector<uint8_t> collected = CollectTags(values);
+    assert(collected == std::vector<uint8_t>({0, 1, 2, 0, 1}));
+    assert(CountTag(collected, 1) == 2);
+
+    std::array<size_t, 3> histogram{};
+    TagHistogram(collected, histogram);
+    assert(histogram == (std::array<size_t, 3>{2, 2, 1}));
+
+    std::vector<size_t> positions(collected.size());
+    size_t count = SelectTag(collected, 0, positions);
+    positions.resize(count);
+    assert(positions == std::vector<size_t>({0, 3}));
+
+    std::vector<size_t> order(collected.size());
+    PartitionByTag(collected, 3, order);
+    assert(order == std::vector<size_t>({0, 3, 1, 4, 2}));
+
+    using F = Variant<int, std::string, Fragile>;
+    std::vector<F> fragile = {MakeValueless<F>(), 1, std::string("a"),
+                              MakeValueless<F>(), 2};
+    std::vector<uint8_t> fragile_tags = CollectTags(fragile);
+    assert(fragile_tags == std::vector<uint8_t>({255, 0, 1, 255, 0}));
+    PartitionByTag(fragile_tags, 3, order);
+    assert(order == std::vector<size_t>({1, 4, 2, 0, 3}));
+
+    VariantVector<int, std::string, double> soa;
+    for (const auto& v : values) {
+        soa.push_back(v);
+    }
+    assert(CountTag(soa.tags(), 2) == 1);
+}
+
+// Fragile is not arithmetic, so a variant holding it is not hashed from its
+// storage bytes. This one is, and opts out for the valueless case of that
+// path.
+using OptedOutBits = Variant<int, uint16_t, float>;
+
+template <>
+struct variant_never_valueless<OptedOutBits> : std::false_type {};
+
+void TestHash() {
+    using V = Variant<int, unsigned, double, char, bool>;
+    std::hash<V> hash;
+    assert(hash(V(5)) == hash(V(5)));
+    assert(hash(V(5)) != hash(V(6)));
+    // Same bits, different alternatives.
+    assert(hash(V(5)) != hash(V(5u)));
+    assert(hash(V(0.0)) == hash(V(-0.0)));
+    assert(hash(V(-1)) != hash(V(-1.0)));
+
+    using S = Variant<int, std::string>;
+    std::hash<S> string_hash;
+    assert(string_hash(S(std::string("key"))) ==
+           string_hash(S(std::string("key"))));
+    assert(string_hash(S(std::string("key"))) !=
+           string_hash(S(std::string("other"))));
+
+    struct Unhashable {};
+    static_assert(std::is_default_constructible_v<std::hash<S>>);
+    static_assert(
+        !std::is_default_constructible_v<std::hash<Variant<int, Unhashable>>>);
+
+    auto equal = [](const S& a, const S& b) {
+        return a.index() == b.index() &&
+               (a.index() == 0 ? Get<0>(a) == Get<0>(b)
+                               : Get<1>(a) == Get<1>(b));
+    };
+    std::unordered_set<S, std::hash<S>, decltype(equal)> set(8, string_hash,
+                                                             equal);
+    set.insert(S(1));
+    set.insert(S(std::string("1")));
+    set.insert(S(1));
+    assert(set.size() == 2);
+    assert(set.contains(S(std::string("1"))));
+
+    // The batch path reads the keys from the storage bytes, and must agree
+    // with std::hash on every alternative.
+    std::vector<V> values;
+    for (size_t i = 0; i < 600; ++i) {
+        switch (i % 6) {
+            case 0:
+                values.emplace_back(static_cast<int>(i) - 1000);
+                break;
+            case 1:
+                values.emplace_back(static_cast<unsigned>(i));
+                break;
+            case 2:
+                values.emplace_back(i % 4 == 0 ? -0.0 : 0.5 * i);
+                break;
+            case 3:
+                values.emplace_back(static_cast<char>(i));
+                break;
+            default:
+                values.emplace_back(i % 2 == 0);
+                break;
+        }
+    }
+    std::vector<size_t> batch(values.size());
+    HashVariants(values, batch);
+    for (size_t i = 0; i < values.size(); ++i) {
+        assert(batch[i] == hash(values[i]));
+    }
+
+    std::vector<S> strings = {S(1), S(std::string("a"))};
+    std::vector<size_t> hashes(strings.size());
+    HashVariants(strings, hashes);
+    for (size_t i = 0; i < strings.size(); ++i) {
+        assert(hashes[i] == string_hash(strings[i]));
+    }
+
+    // Valueless variants, on both paths.
+    using Bits = OptedOutBits;
+    using F = Variant<int, std::string, Fragile>;
+    Bits valueless_bits = MakeValueless<Bits>();
+    F valueless = MakeValueless<F>();
+    assert(std::hash<F>()(valueless) == std::hash<F>()(valueless));
+    assert(std::hash<Bits>()(valueless_bits) != std::hash<Bits>()(Bits(0)));
+
+    std::vector<Bits> bits = {Bits(1), valueless_bits, Bits(0.5f)};
+    std::vector<size_t> bit_hashes(bits.size());
+    HashVariants(bits, bit_hashes);
+    for (size_t i = 0; i < bits.size(); ++i) {
+        assert(bit_hashes[i] == std::hash<Bits>()(bits[i]));
+    }
+
+    std::vector<F> fragile = {F(1), F(std::string("a")), valueless};
+    std::vector<size_t> fragile_hashes(fragile.size());
+    HashVariants(fragile, fragile_hashes);
+    for (size_t i = 0; i < fragile.size(); ++i) {
+        assert(fragile_hashes[i] == std::hash<F>()(fragile[i]));
+    }
+}
+
+void TestComparisons() {
+    using V = Variant<int, double, std::string>;
+    using StdV = std::variant<int, double, std::string>;
+
+    // Every pair of values compares as it does in std::variant.
+    std::vector<V> values = {1, 2, -1, 0.5, 1.0, std::string("a"),
+                             std::string("b"), std::string("")};
+    std::vector<StdV> std_values = {1, 2, -1, 0.5, 1.0, std::string("a"),
+                                    std::string("b"), std::string("")};
+    for (size_t i = 0; i < values.size(); ++i) {
+        for (size_t j = 0; j < values.size(); ++j) {
+            const V& v = values[i];
+            const V& w = values[j];
+            const StdV& x = std_values[i];
+            const StdV& y = std_values[j];
+            assert((v == w) == (x == y));
+            assert((v != w) == (x != y));
+            assert((v < w) == (x < y));
+            assert((v > w) == (x > y));
+            assert((v <= w) == (x <= y));
+            assert((v >= w) == (x >= y));
+            assert((v <=> w) == (x <=> y));
+        }
+    }
+
+    // Valueless variants come before all others and equal each other.
+    using F = Variant<int, std::string, Fragile>;
+    F valueless = MakeValueless<F>();
+    for (const F& v : {F(-1), F(std::string()), F(Fragile::VALUE)}) {
+        assert(valueless < v && valueless <= v && v > valueless);
+        assert(valueless != v && !(valueless == v));
+        assert((valueless <=> v) == std::partial_ordering::less);
+    }
+    assert(valueless == MakeValueless<F>() && valueless >= valueless);
+    assert((valueless <=> valueless) == std::partial_ordering::equivalent);
+
+    static_assert(std::is_same_v<decltype(V(1) <=> V(1)),
+                                 std::partial_ordering>);
+    static_assert(std::is_same_v<decltype(Variant<int, char>(1) <=>
+                                          Variant<int, char>(1)),
+                                 std::strong_ordering>);
+
+    struct Incomparable {};
+    static_assert(std::equality_comparable<V>);
+    static_assert(std::totally_ordered<Variant<int, std::string>>);
+    static_assert(!std::equality_comparable<Variant<int, Incomparable>>);
+    static_assert(!std::three_way_comparable<Variant<int, Incomparable>>);
+
+    static_assert(Variant<int, char>(1) < Variant<int, char>('a'));
+    static_assert(Variant<int, char>(2) == Variant<int, char>(2));
+    static_assert(Variant<int, char>('b') > Variant<int, char>('a'));
+
+    // Only the operator of the alternative is used, as in std::variant.
+    struct OnlyLess {
+        int value;
+
+        bool operator<(const OnlyLess& other) const {
+            return value < other.value;
+        }
+    };
+    Variant<OnlyLess, int> small = OnlyLess{1};
+    Variant<OnlyLess, int> large = OnlyLess{2};
+    assert(small < large);
+    assert(!(large < small));
+
+    std::vector<V> sorted = {std::string("b"), 3.5, 2, std::string("a"), 1};
+    std::sort(sorted.begin(), sorted.end());
+    assert(sorted == std::vector<V>({1, 2, 3.5, std::string("a"),
+                                     std::string("b")}));
+}
+
+struct Large {
+    std::array<int, 128> values{};
+
+    Large() = default;
+
+    explicit Large(int first) {
+        values[0] = first;
+    }
+
+    bool operator==(const Large& other) const = default;
+    auto operator<=>(const Large& other) const = default;
+};
+
+// A binary tree whose nodes hold their children by value, through a box.
+struct TreeNode;
+using Tree = Variant<int, Boxed<TreeNode>>;
+
+struct TreeNode {
+    Tree left;
+    Tree right;
+};
+
+int SumTree(const Tree& tree) {
+    return Visit(Overload{[](int leaf) {
+                              return leaf;
+                          },
+                          [](const TreeNode& node) {
+                              return SumTree(node.left) + SumTree(node.right);
+                          }},
+                 tree);
+}
+
+void TestBoxed() {
+    using V = Variant<int, double, Boxed<Large>>;
+    static_assert(sizeof(V) <= 2 * sizeof(double));
+    static_assert(sizeof(Variant<int, double, Large>) > sizeof(Large));
+
+    V v = Large(7);
+    assert(v.index() == 2);
+    assert(holds_alternative<Large>(v));
+    assert(holds_alternative<Boxed<Large>>(v));
+    static_assert(std::is_same_v<decltype(Get<2>(v)), Large&>);
+    static_assert(std::is_same_v<decltype(Get<Large>(v)), Large&>);
+    static_assert(std::is_same_v<decltype(Get<Boxed<Large>>(v)), Large&>);
+    static_assert(
+        std::is_same_v<decltype(Get<Large>(std::move(v))), Large&&>);
+    static_assert(std::is_same_v<decltype(GetIf<2>(&v)), Large*>);
+    assert(Get<Large>(v).values[0] == 7);
+    assert(GetIf<Large>(&v) == &Get<2>(v));
+    assert(GetIf<int>(&v) == nullptr);
+    assert(Visit(
+        [](const auto& value) {
+            return std::is_same_v<std::decay_t<decltype(value)>, Large>;
+        },
+        v));
+
+    // Copies are deep, moves hand the box over.
+    V copy = v;
+    Get<Large>(copy).values[0] = 8;
+    assert(Get<Large>(v).values[0] == 7);
+    Large* boxed = &Get<Large>(v);
+    V moved = std::move(v);
+    assert(&Get<Large>(moved) == boxed);
+    // The source keeps its index, but its box is empty.
+    assert(v.index() == 2 && GetIf<Large>(&v) == nullptr);
+    try {
+        Get<Large>(v);
+        assert(false);
+    } catch (const std::runtime_error&) {
+        // ok
+    }
+    size_t allocations = allocation_count;
+    copy = moved;
+    assert(allocation_count == allocations);
+    assert(Get<Large>(copy).values[0] == 7);
+    swap(copy, moved);
+    Large* target = &Get<Large>(copy);
+    copy = Large(9);
+    assert(&Get<Large>(copy) == target && target->values[0] == 9);
+    v = 1.5;
+    assert(Get<double>(v) == 1.5);
+
+    Large& emplaced = v.emplace<Large>(3);
+    assert(&emplaced == &Get<Large>(v) && emplaced.values[0] == 3);
+    v.emplace<Boxed<Large>>();
+    assert(Get<Large>(v).values[0] == 0);
+    static_assert(!noexcept(v.emplace<Large>()));
+
+    assert(V(Large(1)) == V(Large(1)));
+    assert(V(Large(1)) < V(Large(2)));
+    assert(V(1) < V(Large(0)));
+    static_assert(!std::is_default_constructible_v<std::hash<V>>);
+    using BoxedString = Variant<int, Boxed<std::string>>;
+    using String = Variant<int, std::string>;
+    assert(std::hash<BoxedString>{}(std::string("boxed")) ==
+           std::hash<String>{}(std::string("boxed")));
+
+    Tree tree = TreeNode{TreeNode{1, 2}, TreeNode{3, TreeNode{4, 5}}};
+    assert(SumTree(tree) == 15);
+    Tree other = tree;
+    Get<TreeNode>(Get<TreeNode>(other).left).left = 10;
+    assert(SumTree(other) == 24);
+    assert(SumTree(tree) == 15);
+    Tree subtree = std::move(Get<TreeNode>(tree).right);
+    assert(SumTree(subtree) == 12);
+
+    // VariantVector keeps the values of boxed alternatives in their pool.
+    VariantVector<int, Boxed<Large>> values;
+    values.push_back(Variant<int, Boxed<Large>>(Large(5)));
+    values.emplace_back<Large>(6);
+    static_assert(std::is_same_v<decltype(values.get<1>(0)), Large&>);
+    assert(Get<Large>(values[0]).values[0] == 5);
+    assert(values.alternative<Large>()[1].values[0] == 6);
+}
+
+// Counts what reaches it, and passes it on to new and delete.
+class CountingResource : public std::pmr::memory_resource {
+  public:
+    size_t allocations = 0;
+    size_t deallocations = 0;
+
+  private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        ++allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override {
+        ++deallocations;
+        std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+    }
+
+    bool do_is_equal(
+        const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+bool IsAligned(const void* ptr, size_t alignment) {
+    return reinterpret_cast<uintptr_t>(ptr) % alignment == 0;
+}
+
+void TestAllocators() {
+    {
+        CountingResource upstream;
+        ArenaResource arena(&upstream);
+        void* first = arena.allocate(1, 1);
+        void* second = arena.allocate(8, 8);
+        void* aligned = arena.allocate(64, 64);
+        assert(IsAligned(second, 8) && IsAligned(aligned, 64));
+        assert(static_cast<char*>(second) > static_cast<char*>(first));
+        arena.deallocate(second, 8, 8);
+        assert(arena.allocate(8, 8) != second);
+        // Larger than a block.
+        void* big = arena.allocate(size_t{1} << 16, 16);
+        assert(IsAligned(big, 16) && upstream.allocations == 2);
+        arena.release();
+        assert(upstream.deallocations == 2);
+    }
+    {
+        CountingResource upstream;
+        PoolResource pool(&upstream);
+        void* first = pool.allocate(24, 8);
+        void* second = pool.allocate(32, 16);
+        assert(IsAligned(second, 16) && upstream.allocations == 1);
+        pool.deallocate(first, 24, 8);
+        assert(pool.allocate(17, 8) == first);
+        assert(pool.allocate(8, 8) != first);
+        void* big = pool.allocate(4096, 8);
+        void* over_aligned = pool.allocate(32, 64);
+        assert(IsAligned(over_aligned, 64) && upstream.allocations == 4);
+        pool.deallocate(big, 4096, 8);
+        pool.deallocate(over_aligned, 32, 64);
+        assert(upstream.deallocations == 2);
+    }
+
+    // A pmr alternative is handed the allocator, a plain one is not.
+    ArenaResource arena;
+    std::pmr::polymorphic_allocator<> alloc(&arena);
+    using V = Variant<int, std::pmr::string>;
+    V v;
+    std::pmr::string& text =
+        v.emplace<std::pmr::string>(std::allocator_arg, alloc, 100, 'x');
+    assert(text.size() == 100 && text.get_allocator() == alloc);
+    assert(v.emplace<0>(std::allocator_arg, alloc, 5) == 5);
+    V constructed(std::allocator_arg, alloc,
+                  std::in_place_type<std::pmr::string>, 3, 'z');
+    assert(Get<std::pmr::string>(constructed) == "zzz");
+    assert(Get<1>(constructed).get_allocator() == alloc);
+    V plain(std::allocator_arg, alloc, std::in_place_index<0>, 6);
+    assert(Get<int>(plain) == 6);
+
+    // A boxed alternative is allocated from the resource, and so are the
+    // allocator aware members of the value in the box.
+    using PmrBoxed = Boxed<std::pmr::string,
+                           std::pmr::polymorphic_allocator<std::pmr::string>>;
+    static_assert(std::uses_allocator_v<PmrBoxed,
+                                        std::pmr::polymorphic_allocator<>>);
+    alignas(std::max_align_t) std::array<std::byte, 4096> buffer;
+    ArenaResource local(buffer.data(), buffer.size(),
+                        std::pmr::null_memory_resource());
+    CountingResource fallback;
+    std::pmr::memory_resource* previous =
+        std::pmr::set_default_resource(&fallback);
+    {
+        using W = Variant<int, PmrBoxed>;
+        W w;
+        // Sets up the instrumentation counters of W, when enabled.
+        w.emplace<0>(0);
+        size_t allocations = allocation_count;
+        std::pmr::string& boxed = w.emplace<1>(
+            std::allocator_arg, std::pmr::polymorphic_allocator<>(&local),
+            200, 'y');
+        assert(allocation_count == allocations && fallback.allocations == 0);
+        assert(boxed.get_allocator().resource() == &local);
+        assert(VariantAccess::raw<1>(w).get_allocator().resource() == &local);
+        auto* begin = reinterpret_cast<char*>(buffer.data());
+        auto* address = reinterpret_cast<char*>(&boxed);
+        assert(address >= begin && address < begin + buffer.size());
+        assert(boxed.data() >= begin && boxed.data() < begin + buffer.size());
+        W built(std::allocator_arg, std::pmr::polymorphic_allocator<>(&local),
+                std::in_place_index<1>, 30, 'q');
+        assert(VariantAccess::raw<1>(built).get_allocator().resource() ==
+               &local);
+        assert(Get<1>(built).get_allocator().resource() == &local);
+
+        // polymorphic_allocator does not propagate to copies, which get the
+        // default resource.
+        W copy = w;
+        assert(Get<1>(copy) == boxed);
+        assert(VariantAccess::raw<1>(copy).get_allocator().resource() ==
+               &fallback);
+        assert(fallback.allocations == 2);
+    }
+    assert(fallback.deallocations == 2);
+    std::pmr::set_default_resource(previous);
+
+    // A move between boxes of different resources moves the value into
+    // memory of the target's.
+    ArenaResource other;
+    PmrBoxed from(std::allocator_arg, &arena, "moved");
+    PmrBoxed to(std::allocator_arg, &other, "old");
+    to = std::move(from);
+    assert(*to == "moved" && to->get_allocator().resource() == &other);
+    assert(to.get_allocator().resource() == &other);
+}
+
+// Can be neither copied nor moved, so it can only be built in place.
+struct Pinned {
+    int first;
+    int second;
+
+    Pinned(int first, int second) : first(first), second(second) {}
+
+    Pinned(std::initializer_list<int> list, int second)
+        : first(static_cast<int>(list.size())), second(second) {}
+
+    Pinned(const Pinned&) = delete;
+    Pinned& operator=(const Pinned&) = delete;
+};
+
+// Counts the moves and copies made of it.
+struct MoveCounted {
+    static inline int moves = 0;
+    static inline int copies = 0;
+
+    int value = 0;
+
+    explicit MoveCounted(int value) : value(value) {}
+
+    MoveCounted(const MoveCounted& other) : value(other.value) {
+        ++copies;
+    }
+
+    MoveCounted(MoveCounted&& other) noexcept : value(other.value) {
+        ++moves;
+    }
+};
+
+template <typename V, size_t Index>
+concept CanEmplaceIndex = requires(V v) { v.template emplace<Index>(); };
+
+template <typename V, typename T>
+concept CanEmplaceType = requires(V v) { v.template emplace<T>(); };
+
+void TestInPlace() {
+    using V = Variant<int, Pinned>;
+    static_assert(!std::is_copy_constructible_v<V>);
+    static_assert(!std::is_move_constructible_v<V>);
+    V by_index(std::in_place_index<1>, 1, 2);
+    assert(by_index.index() == 1);
+    assert(Get<Pinned>(by_index).first == 1);
+    assert(Get<Pinned>(by_index).second == 2);
+    V by_type(std::in_place_type<Pinned>, {5, 6, 7}, 8);
+    assert(Get<1>(by_type).first == 3 && Get<1>(by_type).second == 8);
+    V list_by_index(std::in_place_index<1>, {1}, 4);
+    assert(Get<1>(list_by_index).first == 1);
+    static_assert(!std::is_convertible_v<std::in_place_index_t<0>, V>);
+    static_assert(!std::is_constructible_v<V, std::in_place_index_t<1>, int>);
+    static_assert(
+        !std::is_constructible_v<V, std::in_place_type_t<double>, double>);
+
+    // Neither an index past the alternatives nor a type that is not one of
+    // them names an alternative, not even one constructible from nothing.
+    using Numeric = Variant<int, double>;
+    static_assert(!std::is_constructible_v<Numeric, std::in_place_index_t<5>>);
+    static_assert(
+        !std::is_constructible_v<Numeric, std::in_place_type_t<char*>>);
+    static_assert(!std::is_constructible_v<Variant<int, Boxed<int>>,
+                                           std::in_place_type_t<int>>);
+    static_assert(!CanEmplaceIndex<Numeric, 2>);
+    static_assert(!CanEmplaceType<Numeric, char*>);
+    static_assert(CanEmplaceIndex<Numeric, 1> && CanEmplaceType<Numeric, int>);
+
+    // Selects the alternative that conversion could not pick.
+    using Numbers = Variant<int, long, std::vector<int>>;
+    Numbers number(std::in_place_index<1>, 7);
+    assert(number.index() == 1 && Get<1>(number) == 7);
+    Numbers list(std::in_place_type<std::vector<int>>, {1, 2, 3});
+    assert(Get<2>(list) == std::vector<int>({1, 2, 3}));
+    Numbers filled(std::in_place_index<2>, 4, 9);
+    assert(Get<2>(filled) == std::vector<int>(4, 9));
+    static_assert(std::is_nothrow_constructible_v<
+                  Numbers, std::in_place_index_t<0>, int>);
+    static_assert(!std::is_nothrow_constructible_v<
+                  Numbers, std::in_place_index_t<2>, int, int>);
+
+    constexpr Variant<int, double> constant(std::in_place_index<1>, 2.5);
+    static_assert(Get<1>(constant) == 2.5);
+
+    // Construction from a value moves it in, in place construction does not.
+    MoveCounted::moves = 0;
+    Variant<int, MoveCounted> moved = MoveCounted(1);
+    assert(MoveCounted::moves == 1);
+    Variant<int, MoveCounted> built(std::in_place_type<MoveCounted>, 2);
+    assert(MoveCounted::moves == 1 && MoveCounted::copies == 0);
+    assert(Get<1>(built).value == 2);
+
+    // The value of a Boxed alternative is built in its box.
+    Variant<int, Boxed<MoveCounted>> boxed(std::in_place_type<MoveCounted>, 3);
+    assert(MoveCounted::moves == 1 && Get<MoveCounted>(boxed).value == 3);
+    Variant<int, Boxed<Pinned>> pinned(std::in_place_index<1>, 4, 5);
+    assert(Get<Pinned>(pinned).second == 5);
+}
+
+struct StatsAlternative {
+    int value = 0;
+};
+
+// So that the test below can count a variant becoming valueless.
+template <>
+struct variant_never_valueless<Variant<int, std::string, StatsAlternative>>
+    : std::false_type {};
+
+void TestInstrumentation() {
+    using V = Variant<int, std::string, StatsAlternative>;
+    V v;
+    v = std::string("text");
+    v = std::string("same alternative, no transition");
+    v.emplace<StatsAlternative>();
+    v.emplace<StatsAlternative>();
+    v = 1;
+    V other = std::string("other");
+    v = other;
+    try {
+        Get<int>(v);
+        assert(false);
+    } catch (const std::runtime_error&) {
+        // ok
+    }
+    V valueless = MakeValueless<V>();
+    v = valueless;
+    for (int i = 0; i < 3; ++i) {
+        Visit([](const auto&) {}, other);
+    }
+    Visit([](const auto&, const auto&) {}, other, V(2));
+
+    if constexpr (variant_util::INSTRUMENTATION) {
+        assert((VariantTransitionCount<V>(0, 1) == 2));
+        assert((VariantTransitionCount<V>(1, 1) == 0));
+        assert((VariantTransitionCount<V>(1, 2) == 1));
+        assert((VariantTransitionCount<V>(2, 2) == 1));
+        assert((VariantTransitionCount<V>(2, 0) == 1));
+        assert((VariantTransitionCount<V>(1, NPOS) == 1));
+        assert(VariantGetFailureCount<V>(0) == 1);
+        assert(VariantGetFailureCount<V>(1) == 0);
+        assert(VariantValuelessCount<V>() == 1);
+        assert((VisitDispatchCount<V>({1}) == 3));
+        assert((VisitDispatchCount<V>({0}) == 0));
+        assert((VisitDispatchCount<V, V>({1, 0}) == 1));
+
+        // Counters of finished threads are kept.
+        std::thread([] {
+            V local;
+            local = std::string("thread");
+        }).join();
+        assert((VariantTransitionCount<V>(0, 1) == 3));
+
+        std::ostringstream dump;
+        DumpVariantStats(dump);
+        assert(dump.str().find("StatsAlternative -> int: 1") !=
+               std::string::npos);
+        assert(dump.str().find("failed Get<int>: 1") != std::string::npos);
+        assert(dump.str().find("became valueless: 1") != std::string::npos);
+    } else {
+        assert((VariantTransitionCount<V>(0, 1) == 0));
+        assert(VariantValuelessCount<V>() == 0);
+        assert((VisitDispatchCount<V>({1}) == 0));
+    }
+}
+
+struct ThrowingCopy {
+    static inline bool fail = false;
+
+    int value = 0;
+
+    explicit ThrowingCopy(int value) : value(value) {}
+
+    ThrowingCopy(const ThrowingCopy& other) : value(other.value) {
+        if (fail) {
+            throw 1;
+        }
+    }
+
+    ThrowingCopy(ThrowingCopy&&) noexcept = default;
+};
+
+void TestNeverValueless() {
+    using V = Variant<int, std::vector<int>, ThrowingCopy>;
+    static_assert(variant_never_valueless<V>::value);
+    static_assert(variant_never_valueless<Variant<int, Boxed<Large>>>::value);
+    static_assert(!variant_never_valueless<Variant<int, Pinned>>::value);
+    static_assert(
+        variant_never_valueless<Variant<int, std::string, double>>::value);
+    static_assert(
+        !variant_never_valueless<Variant<int, std::string, Fragile>>::value);
+    static_assert(!Variant<int, double>(2.5).valueless_by_exception());
+
+    struct Thrower {
+        operator int() const {
+            throw 1;
+        }
+    };
+
+    // A throwing emplace or assignment keeps the old alternative.
+    V v = std::vector<int>{1, 2, 3};
+    try {
+        v.emplace<int>(Thrower());
+        assert(false);
+    } catch (int) {
+        // ok
+    }
+    assert(!v.valueless_by_exception());
+    assert(Get<std::vector<int>>(v) == std::vector<int>({1, 2, 3}));
+
+    V copied(std::in_place_type<ThrowingCopy>, 4);
+    ThrowingCopy::fail = true;
+    try {
+        v = copied;
+        assert(false);
+    } catch (int) {
+        // ok
+    }
+    try {
+        v.emplace<ThrowingCopy>(Get<ThrowingCopy>(copied));
+        assert(false);
+    } catch (int) {
+        // ok
+    }
+    assert(v.index() == 1 && Get<1>(v).size() == 3);
+    ThrowingCopy::fail = false;
+    v = copied;
+    assert(Get<ThrowingCopy>(v).value == 4);
+    assert(Visit([](const auto&, const auto&) { return 1; }, v, copied) == 1);
+
+    // Only constructors that may throw go through a temporary.
+    Variant<int, MoveCounted> counted;
+    MoveCounted::moves = 0;
+    counted.emplace<MoveCounted>(MoveCounted(1));
+    assert(MoveCounted::moves == 1);
+    counted.emplace<int>(2);
+    counted.emplace<MoveCounted>(3);
+    assert(MoveCounted::moves == 2 && Get<MoveCounted>(counted).value == 3);
+
+    // Variants that opt out still become valueless, and cannot be visited.
+    using F = Variant<int, std::string, Fragile>;
+    F valueless = MakeValueless<F>();
+    assert(valueless.valueless_by_exception());
+    try {
+        Visit([](const auto&, const auto&) {}, F(1), valueless);
+        assert(false);
+    } catch (const std::runtime_error&) {
+        // ok
+    }
+}
+
+using Hinted = Variant<char, long, std::string>;
+
+template <>
+struct variant_likely_alternative<Hinted> : std::integral_constant<size_t, 2> {
+};
+
+void TestVisitLikely() {
+    auto describe = [](const auto& alt) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(alt)>,
+                                     std::string>) {
+            return "string " + alt;
+        } else {
+            return std::to_string(alt);
+        }
+    };
+
+    // Whether the hint is right or not, the result is that of Visit.
+    Variant<int, double, std::string> v = std::string("hot");
+    assert(VisitLikely<2>(describe, v) == "string hot");
+    assert(VisitLikely<0>(describe, v) == "string hot");
+    v = 3;
+    assert(VisitLikely<2>(describe, v) == Visit(describe, v));
+    assert(VisitLikely<0>(describe, v) == "3");
+
+    // The value category of the variant is kept on both paths.
+    auto take = [](auto&& alt) {
+        return std::is_rvalue_reference_v<decltype(alt)>;
+    };
+    v = std::string("moved");
+    assert(VisitLikely<2>(take, std::move(v)));
+    assert(VisitLikely<0>(take, std::move(v)));
+    assert(!VisitLikely<2>(take, v));
+
+    static_assert(VisitLikely<1>(
+                      [](auto alt) {
+                          return static_cast<double>(alt);
+                      },
+                      Variant<int, double>(2.5)) == 2.5);
+
+    // Visit of a single Hinted tests for its string alternative first.
+    Hinted hinted = std::string("hinted");
+    assert(Visit(describe, hinted) == "string hinted");
+    hinted = 7L;
+    assert(Visit(describe, hinted) == "7");
+    assert(Visit(
+               [](const auto& a, const auto& b) {
+                   return sizeof(a) + sizeof(b);
+               },
+               hinted, Hinted('c')) == sizeof(long) + 1);
+
+    auto valueless = MakeValueless<Variant<int, std::string, Fragile>>();
+    try {
+        VisitLikely<0>([](const auto&) {}, valueless);
+        assert(false);
+    } catch (const std::runtime_error&) {
+        // ok
+    }
+}
+
+// Two equal halves, which a torn read would tell apart.
+struct Halves {
+    int64_t first;
+    int64_t second;
+};
+
+void TestAtomicVariant() {
+    using Small = AtomicVariant<int32_t, float, bool>;
+    using Large = AtomicVariant<int64_t, double, Halves>;
+    static_assert(Small::is_always_lock_free);
+    static_assert(!Large::is_always_lock_free);
+    // The index does not fit next to eight bytes of alternative.
+    static_assert(!AtomicVariant<int64_t, double, bool>::is_always_lock_free);
+
+    Small small(1.5f);
+    assert(Get<float>(small.load()) == 1.5f);
+    small.store(true);
+    assert(Get<bool>(small.exchange(7)));
+    Small::value_type expected = 8;
+    assert(!small.compare_exchange_strong(expected, false));
+    assert(Get<int32_t>(expected) == 7);
+    assert(small.compare_exchange_strong(expected, false));
+    assert(!Get<bool>(small.load()));
+
+    Large large;
+    assert(Get<int64_t>(large.load()) == 0);
+    large.store(Halves{3, 3});
+    assert(Get<Halves>(large.exchange(2.5)).second == 3);
+    Large::value_type old_value = 2.5;
+    assert(large.compare_exchange_strong(old_value, int64_t{4}));
+    old_value = 2.5;
+    assert(!large.compare_exchange_weak(old_value, int64_t{5}));
+    assert(Get<int64_t>(old_value) == 4);
+
+    // Readers see whole values only, and compare-exchange loops do not lose
+    // updates.
+    constexpr int64_t WRITES = 20000;
+    std::atomic<bool> done = false;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 2; ++i) {
+        readers.emplace_back([&] {
+            while (!done) {
+                Large::value_type v = large.load();
+                if (const Halves* halves = GetIf<Halves>(&v)) {
+                    assert(halves->first == halves->second);
+                }
+            }
+        });
+    }
+    Large counter(int64_t{0});
+    std::vector<std::thread> writers;
+    for (int i = 0; i < 2; ++i) {
+        writers.emplace_back([&, i] {
+            for (int64_t n = 0; n < WRITES; ++n) {
+                large.store(Halves{n + i, n + i});
+                Large::value_type seen = counter.load();
+                while (!counter.compare_exchange_weak(
+                    seen, Get<int64_t>(seen) + 1)) {
+                }
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    assert(Get<int64_t>(counter.load()) == 2 * WRITES);
+}
+
 int main() {
 
     std::cerr << "Tests started." << std::endl;
@@ -419,6 +2181,75 @@ int main() {
     TestMultipleVisit();
     std::cerr << "Test 7 (multiple visit) passed." << std::endl;
 
+    TestIndexSize();
+    std::cerr << "Test 8 (index size) passed." << std::endl;
+
+    TestTrivialSpecialMembers();
+    std::cerr << "Test 9 (trivial special members) passed." << std::endl;
+
+    TestVisitDispatch();
+    std::cerr << "Test 10 (visit dispatch) passed." << std::endl;
+
+    TestFlatMultipleVisit();
+    std::cerr << "Test 11 (flat multiple visit) passed." << std::endl;
+
+    TestSingleDispatchLifetime();
+    std::cerr << "Test 12 (single dispatch lifetime) passed." << std::endl;
+
+    TestSameAlternativeAssignment();
+    std::cerr << "Test 13 (same alternative assignment) passed." << std::endl;
+
+    TestNoexcept();
+    std::cerr << "Test 14 (noexcept) passed." << std::endl;
+
+    TestConstexpr();
+    std::cerr << "Test 15 (constexpr) passed." << std::endl;
+
+    TestGetIf();
+    std::cerr << "Test 16 (get if) passed." << std::endl;
+
+    TestAlignedStorage();
+    std::cerr << "Test 17 (aligned storage) passed." << std::endl;
+
+    TestTypeListLookup();
+    std::cerr << "Test 18 (type list lookup) passed." << std::endl;
+
+    TestVariantVector();
+    std::cerr << "Test 19 (variant vector) passed." << std::endl;
+
+    TestVisitAll();
+    std::cerr << "Test 20 (visit all) passed." << std::endl;
+
+    TestTagScans();
+    std::cerr << "Test 21 (tag scans) passed." << std::endl;
+
+    TestHash();
+    std::cerr << "Test 22 (hash) passed." << std::endl;
+
+    TestComparisons();
+    std::cerr << "Test 23 (comparisons) passed." << std::endl;
+
+    TestBoxed();
+    std::cerr << "Test 24 (boxed) passed." << std::endl;
+
+    TestAllocators();
+    std::cerr << "Test 25 (allocators) passed." << std::endl;
+
+    TestInPlace();
+    std::cerr << "Test 26 (in place) passed." << std::endl;
+
+    TestInstrumentation();
+    std::cerr << "Test 27 (instrumentation) passed." << std::endl;
+
+    TestNeverValueless();
+    std::cerr << "Test 28 (never valueless) passed." << std::endl;
+
+    TestVisitLikely();
+    std::cerr << "Test 29 (likely visit) passed." << std::endl;
+
+    TestAtomicVariant();
+    std::cerr << "Test 30 (atomic variant) passed." << std::endl;
+
     std::cout << 0;
 }
 
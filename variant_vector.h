@@ -0,0 +1,413 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "variant.h"
+
+template <typename... Types>
+class VariantVector;
+
+namespace variant_util {
+template <typename T, typename V>
+constexpr size_t index_of_v = NPOS;
+
+template <typename T, typename... Types>
+constexpr size_t index_of_v<T, Variant<Types...>> =
+    alternative_index_v<T, Types...>;
+
+// Pool of bool values. std::vector<bool> packs them into bits, so it has
+// neither bool& elements nor data(); this one keeps a plain bool array.
+class bool_pool {
+  public:
+    bool_pool() = default;
+
+    bool_pool(const bool_pool& other)
+        : values_(std::make_unique<bool[]>(other.size_)),
+          size_(other.size_),
+          capacity_(other.size_) {
+        std::copy_n(other.data(), size_, data());
+    }
+
+    bool_pool(bool_pool&& other) noexcept
+        : values_(std::move(other.values_)),
+          size_(std::exchange(other.size_, 0)),
+          capacity_(std::exchange(other.capacity_, 0)) {}
+
+    bool_pool& operator=(bool_pool other) noexcept {
+        std::swap(values_, other.values_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+        return *this;
+    }
+
+    template <typename... Args>
+    bool& emplace_back(Args&&... args) {
+        if (size_ == capacity_) {
+            capacity_ = std::max<size_t>(2 * capacity_, 16);
+            auto values = std::make_unique<bool[]>(capacity_);
+            std::copy_n(data(), size_, values.get());
+            values_ = std::move(values);
+        }
+        values_[size_] = bool(std::forward<Args>(args)...);
+        return values_[size_++];
+    }
+
+    void pop_back() {
+        --size_;
+    }
+
+    void clear() {
+        size_ = 0;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool* data() {
+        return values_.get();
+    }
+
+    const bool* data() const {
+        return values_.get();
+    }
+
+    bool* begin() {
+        return data();
+    }
+
+    bool* end() {
+        return data() + size_;
+    }
+
+    const bool* begin() const {
+        return data();
+    }
+
+    const bool* end() const {
+        return data() + size_;
+    }
+
+    bool& back() {
+        return values_[size_ - 1];
+    }
+
+    bool& operator[](size_t position) {
+        return values_[position];
+    }
+
+    const bool& operator[](size_t position) const {
+        return values_[position];
+    }
+
+  private:
+    std::unique_ptr<bool[]> values_;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+};
+
+// Pool of the values of one alternative.
+template <typename T>
+using pool_t = std::conditional_t<std::is_same_v<T, bool>, bool_pool,
+                                  std::vector<T>>;
+}  // namespace variant_util
+
+// What VariantVector::operator[] and its iterators return in place of a
+// Variant&: the element's index and its alternative, which lives in the pool
+// of that alternative. Get, GetIf, holds_alternative and Visit accept it like
+// a variant. The held alternative can be modified, but not replaced by
+// another one.
+template <typename Vector>
+class VariantVectorReference {
+  public:
+    using variant_type = typename std::remove_const_t<Vector>::value_type;
+
+    VariantVectorReference(Vector& vector, size_t position)
+        : vector_(&vector), position_(position) {}
+
+    size_t index() const {
+        return vector_->index(position_);
+    }
+
+    template <size_t Index>
+    auto& get() const {
+        return vector_->template get<Index>(position_);
+    }
+
+    operator variant_type() const {
+        return variant_util::dispatch_index<variant_size<variant_type>::value>(
+            index(), [this](auto index) {
+                return variant_type(get<index>());
+            });
+    }
+
+  private:
+    Vector* vector_;
+    size_t position_;
+};
+
+// Sequence of Variant<Types...> stored as a structure of arrays: one tag per
+// element, and one contiguous pool per alternative that holds only the
+// elements with that alternative. An element costs its tag, its offset in
+// the pool and its own payload rather than the size of the largest
+// alternative, and all the values of one alternative can be walked as a
+// plain array.
+template <typename... Types>
+class VariantVector {
+  public:
+    using value_type = Variant<Types...>;
+    using reference = VariantVectorReference<VariantVector>;
+    using const_reference = VariantVectorReference<const VariantVector>;
+
+    // Type of the values of the alternative Index, unboxed.
+    template <size_t Index>
+    using alternative_t = unbox_t<get_type_by_index_t<Index, Types...>>;
+
+    template <typename Vector>
+    class basic_iterator {
+      public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Variant<Types...>;
+        using difference_type = std::ptrdiff_t;
+        using reference = VariantVectorReference<Vector>;
+
+        basic_iterator() = default;
+
+        basic_iterator(Vector* vector, size_t position)
+            : vector_(vector), position_(position) {}
+
+        reference operator*() const {
+            return reference(*vector_, position_);
+        }
+
+        basic_iterator& operator++() {
+            ++position_;
+            return *this;
+        }
+
+        basic_iterator operator++(int) {
+            basic_iterator copy = *this;
+            ++position_;
+            return copy;
+        }
+
+        bool operator==(const basic_iterator& other) const {
+            return position_ == other.position_;
+        }
+
+      private:
+        Vector* vector_ = nullptr;
+        size_t position_ = 0;
+    };
+
+    using iterator = basic_iterator<VariantVector>;
+    using const_iterator = basic_iterator<const VariantVector>;
+
+    size_t size() const {
+        return tags_.size();
+    }
+
+    bool empty() const {
+        return tags_.empty();
+    }
+
+    void reserve(size_t capacity) {
+        tags_.reserve(capacity);
+        offsets_.reserve(capacity);
+    }
+
+    void clear() {
+        tags_.clear();
+        offsets_.clear();
+        std::apply(
+            [](auto&... pools) {
+                (pools.clear(), ...);
+            },
+            pools_);
+    }
+
+    // Throws when value is valueless.
+    void push_back(const value_type& value) {
+        push_variant(value);
+    }
+
+    void push_back(value_type&& value) {
+        push_variant(std::move(value));
+    }
+
+    // Strong guarantee: the tags and offsets are grown first, so that the
+    // value is only added to its pool once nothing else can throw.
+    template <size_t Index, typename... Args>
+    alternative_t<Index>& emplace_back(Args&&... args) {
+        auto& pool = std::get<Index>(pools_);
+        if (pool.size() > std::numeric_limits<offset_t>::max()) {
+            throw std::length_error("VariantVector pool is full!");
+        }
+        if (size() == std::min(tags_.capacity(), offsets_.capacity())) {
+            reserve(std::max<size_t>(2 * size(), 16));
+        }
+        pool.emplace_back(std::forward<Args>(args)...);
+        tags_.push_back(static_cast<index_t>(Index));
+        offsets_.push_back(static_cast<offset_t>(pool.size() - 1));
+        return pool.back();
+    }
+
+    template <typename T, typename... Args>
+    T& emplace_back(Args&&... args) {
+        return emplace_back<alternative_index_v<T, Types...>>(
+            std::forward<Args>(args)...);
+    }
+
+    // The last element is always the last entry of its pool.
+    void pop_back() {
+        variant_util::dispatch_index<sizeof...(Types)>(
+            tags_.back(), [this](auto index) {
+                std::get<index>(pools_).pop_back();
+            });
+        tags_.pop_back();
+        offsets_.pop_back();
+    }
+
+    size_t index(size_t position) const {
+        return tags_[position];
+    }
+
+    // index() of every element, in order.
+    std::span<const index_type_t<sizeof...(Types)>> tags() const {
+        return tags_;
+    }
+
+    // The element at position must hold the alternative Index.
+    template <size_t Index>
+    alternative_t<Index>& get(size_t position) {
+        return std::get<Index>(pools_)[offsets_[position]];
+    }
+
+    template <size_t Index>
+    const alternative_t<Index>& get(size_t position) const {
+        return std::get<Index>(pools_)[offsets_[position]];
+    }
+
+    reference operator[](size_t position) {
+        return reference(*this, position);
+    }
+
+    const_reference operator[](size_t position) const {
+        return const_reference(*this, position);
+    }
+
+    iterator begin() {
+        return iterator(this, 0);
+    }
+
+    iterator end() {
+        return iterator(this, size());
+    }
+
+    const_iterator begin() const {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, size());
+    }
+
+    // Every value of one alternative, in insertion order.
+    template <size_t Index>
+    std::span<alternative_t<Index>> alternative() {
+        return std::get<Index>(pools_);
+    }
+
+    template <size_t Index>
+    std::span<const alternative_t<Index>> alternative() const {
+        return std::get<Index>(pools_);
+    }
+
+    template <typename T>
+    std::span<T> alternative() {
+        return alternative<alternative_index_v<T, Types...>>();
+    }
+
+    template <typename T>
+    std::span<const T> alternative() const {
+        return alternative<alternative_index_v<T, Types...>>();
+    }
+
+  private:
+    using index_t = index_type_t<sizeof...(Types)>;
+    // 32 bits keep the per-element overhead at a few bytes; a single pool is
+    // limited to 2^32 values.
+    using offset_t = uint32_t;
+
+    template <typename V>
+    void push_variant(V&& value) {
+        if (value.valueless_by_exception()) {
+            variant_util::throw_bad_variant_access();
+        }
+        variant_util::dispatch_index<sizeof...(Types)>(
+            value.index(), [&](auto index) {
+                emplace_back<index>(
+                    UncheckedGet<index>(std::forward<V>(value)));
+            });
+    }
+
+    std::vector<index_t> tags_;
+    std::vector<offset_t> offsets_;
+    // A vector cannot hold const elements; get and alternative add the
+    // const of such alternatives back. Boxed alternatives are stored
+    // unboxed: the pools already keep them apart from the small ones.
+    std::tuple<variant_util::pool_t<std::remove_const_t<unbox_t<Types>>>...>
+        pools_;
+};
+
+template <size_t Index, typename Vector>
+auto& Get(VariantVectorReference<Vector> ref) {
+    if (ref.index() != Index) [[unlikely]] {
+        variant_util::throw_bad_variant_access();
+    }
+    return ref.template get<Index>();
+}
+
+template <typename T, typename Vector>
+auto& Get(VariantVectorReference<Vector> ref) {
+    using variant_type = typename VariantVectorReference<Vector>::variant_type;
+    return Get<variant_util::index_of_v<T, variant_type>>(ref);
+}
+
+template <size_t Index, typename Vector>
+auto* GetIf(VariantVectorReference<Vector> ref) noexcept {
+    using result_t = decltype(&ref.template get<Index>());
+    return ref.index() == Index ? &ref.template get<Index>()
+                                : result_t(nullptr);
+}
+
+template <typename T, typename Vector>
+auto* GetIf(VariantVectorReference<Vector> ref) noexcept {
+    using variant_type = typename VariantVectorReference<Vector>::variant_type;
+    return GetIf<variant_util::index_of_v<T, variant_type>>(ref);
+}
+
+template <typename T, typename Vector>
+bool holds_alternative(VariantVectorReference<Vector> ref) {
+    using variant_type = typename VariantVectorReference<Vector>::variant_type;
+    return ref.index() == variant_util::index_of_v<T, variant_type>;
+}
+
+template <typename F, typename Vector>
+decltype(auto) Visit(F&& f, VariantVectorReference<Vector> ref) {
+    using variant_type = typename VariantVectorReference<Vector>::variant_type;
+    return variant_util::dispatch_index<variant_size<variant_type>::value>(
+        ref.index(), [&](auto index) -> decltype(auto) {
+            return std::invoke(std::forward<F>(f), ref.template get<index>());
+        });
+}
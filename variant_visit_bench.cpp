@@ -0,0 +1,53 @@
+// Translation unit for compile-time and code-size measurements of Visit:
+// visits VISITED variants of ALTERNATIVES alternatives each at once, which
+// instantiates one dispatcher per combination of alternatives, that is
+// ALTERNATIVES^VISITED of them. Built, not run, by make bench_compile.
+
+#include <array>
+#include <utility>
+
+#include "variant.h"
+
+// NOLINTBEGIN
+
+#ifndef ALTERNATIVES
+#define ALTERNATIVES 8
+#endif
+
+#ifndef VISITED
+#define VISITED 2
+#endif
+
+template <size_t I>
+struct Alt {
+    int value;
+};
+
+template <size_t... Is>
+auto MakeAltVariant(std::index_sequence<Is...>) -> Variant<Alt<Is>...>;
+
+using V = decltype(MakeAltVariant(std::make_index_sequence<ALTERNATIVES>{}));
+
+struct Sum {
+    template <typename... Alts>
+    int operator()(const Alts&... alts) const {
+        return (alts.value + ...);
+    }
+};
+
+template <size_t... Ks>
+int VisitEvery(const std::array<V, VISITED>& vs,
+               std::index_sequence<Ks...> /*unused*/) {
+    return Visit(Sum(), vs[Ks]...);
+}
+
+int VisitAllOf(const std::array<V, VISITED>& vs) {
+    return VisitEvery(vs, std::make_index_sequence<VISITED>{});
+}
+
+int main() {
+    std::array<V, VISITED> vs{};
+    return VisitAllOf(vs);
+}
+
+// NOLINTEND